@@ -0,0 +1,511 @@
+#include <converter/common.hpp>
+#include <converter/dvdb_container.hpp>
+#include <converter/dvdb_converter.hpp>
+#include <converter/dvdb_sequence_converter.hpp>
+#include <converter/nvdb_converter.hpp>
+#include <dvdb/dct.hpp>
+#include <utils/cpu_architecture.hpp>
+#include <utils/thread_pool.hpp>
+
+#include <openvdb/openvdb.h>
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <future>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+enum class command_e
+{
+    VDB_TO_NVDB,
+    NVDB_TO_DVDB,
+    VDB_TO_DVDB,
+    DVDB_TO_CONTAINER,
+};
+
+struct options
+{
+    command_e command;
+    std::filesystem::path input_directory;
+    std::filesystem::path output_directory;
+    size_t thread_count = std::thread::hardware_concurrency();
+    float max_error = 0;
+    size_t target_frame_size = 0;
+    int keyframe_interval = 0;
+    int max_chain_length = 0;
+    float scene_cut_ratio = 0;
+    int bidirectional_frames = 0;
+    int reference_frames = 1;
+    bool dct_residuals = true;
+    bool container = false;
+    int parallel_gops = -1; // negative means sequential encoding
+    converter::nvdb_format format = converter::nvdb_format::F32;
+    converter::nvdb_error_method error_method = converter::nvdb_error_method::relative;
+    float nvdb_error = 0.01;
+};
+
+void print_usage(const char *argv0)
+{
+    std::cout << "Usage: " << argv0 << " <command> [options] <input directory>\n"
+              << "\n"
+              << "Commands:\n"
+              << "  vdb-to-nvdb       Convert enumerated .vdb files to .nvdb files\n"
+              << "  nvdb-to-dvdb      Convert enumerated .nvdb files to .dvdb files\n"
+              << "  vdb-to-dvdb       Run both stages one after another\n"
+              << "  dvdb-to-container Bundle enumerated .dvdb files into a single .dvdbs file\n"
+              << "\n"
+              << "Options:\n"
+              << "  -o, --output <dir>           Output directory (default: next to input files)\n"
+              << "  -j, --threads <n>            Worker thread count (default: all cores)\n"
+              << "  -e, --max-error <value>      DiffVDB max error (default: 0)\n"
+              << "  -t, --target-size <bytes>    Adjust max error to hit compressed diff frame size\n"
+              << "  -k, --keyframe-interval <n>  Keyframe on every n-th frame (default: 0, off)\n"
+              << "      --max-chain <n>          Max diff frames after a keyframe (default: 0, off)\n"
+              << "      --scene-cut <ratio>      Keyframe when diff exceeds ratio of full frame (default: 0, off)\n"
+              << "  -b, --b-frames <n>           Frames between anchors predicted from both sides (default: 0, off)\n"
+              << "  -r, --references <n>         Past anchors a leaf may be predicted from, 1 to 3 (default: 1)\n"
+              << "      --no-dct                 Don't try DCT coded residuals, faster encoding\n"
+              << "  -c, --container              Also bundle converted .dvdb files into a single .dvdbs file\n"
+              << "  -g, --parallel-gops <n>      Encode GOPs of keyframe interval length (default 30) in parallel,\n"
+              << "                               n at once, 0 means one per thread\n"
+              << "  -f, --format <f32|f16|f8|f4|fn>\n"
+              << "                               NanoVDB value format (default: f32)\n"
+              << "      --nvdb-error <value>     NanoVDB FN oracle tolerance (default: 0.01)\n"
+              << "      --nvdb-absolute          Use absolute instead of relative FN oracle\n";
+}
+
+std::optional<converter::nvdb_format> parse_format(std::string_view str)
+{
+    if (str == "f32")
+    {
+        return converter::nvdb_format::F32;
+    }
+
+    if (str == "f16")
+    {
+        return converter::nvdb_format::F16;
+    }
+
+    if (str == "f8")
+    {
+        return converter::nvdb_format::F8;
+    }
+
+    if (str == "f4")
+    {
+        return converter::nvdb_format::F4;
+    }
+
+    if (str == "fn")
+    {
+        return converter::nvdb_format::FN;
+    }
+
+    return std::nullopt;
+}
+
+std::optional<options> parse_options(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        return std::nullopt;
+    }
+
+    options opts;
+
+    if (std::string_view command = argv[1]; command == "vdb-to-nvdb")
+    {
+        opts.command = command_e::VDB_TO_NVDB;
+    }
+    else if (command == "nvdb-to-dvdb")
+    {
+        opts.command = command_e::NVDB_TO_DVDB;
+    }
+    else if (command == "vdb-to-dvdb")
+    {
+        opts.command = command_e::VDB_TO_DVDB;
+    }
+    else if (command == "dvdb-to-container")
+    {
+        opts.command = command_e::DVDB_TO_CONTAINER;
+    }
+    else
+    {
+        std::cerr << "Unknown command: " << command << '\n';
+        return std::nullopt;
+    }
+
+    for (int i = 2; i < argc; ++i)
+    {
+        std::string_view arg = argv[i];
+
+        auto next_value = [&]() -> const char * {
+            if (i + 1 >= argc)
+            {
+                throw std::runtime_error("Missing value for option: " + std::string(arg));
+            }
+
+            return argv[++i];
+        };
+
+        if (arg == "-o" || arg == "--output")
+        {
+            opts.output_directory = next_value();
+        }
+        else if (arg == "-j" || arg == "--threads")
+        {
+            opts.thread_count = std::stoul(next_value());
+        }
+        else if (arg == "-e" || arg == "--max-error")
+        {
+            opts.max_error = std::stof(next_value());
+        }
+        else if (arg == "-t" || arg == "--target-size")
+        {
+            opts.target_frame_size = std::stoull(next_value());
+        }
+        else if (arg == "-k" || arg == "--keyframe-interval")
+        {
+            opts.keyframe_interval = std::stoi(next_value());
+        }
+        else if (arg == "-g" || arg == "--parallel-gops")
+        {
+            opts.parallel_gops = std::stoi(next_value());
+        }
+        else if (arg == "--max-chain")
+        {
+            opts.max_chain_length = std::stoi(next_value());
+        }
+        else if (arg == "--scene-cut")
+        {
+            opts.scene_cut_ratio = std::stof(next_value());
+        }
+        else if (arg == "-b" || arg == "--b-frames")
+        {
+            opts.bidirectional_frames = std::stoi(next_value());
+        }
+        else if (arg == "-r" || arg == "--references")
+        {
+            opts.reference_frames = std::stoi(next_value());
+        }
+        else if (arg == "--no-dct")
+        {
+            opts.dct_residuals = false;
+        }
+        else if (arg == "-c" || arg == "--container")
+        {
+            opts.container = true;
+        }
+        else if (arg == "-f" || arg == "--format")
+        {
+            const auto format = parse_format(next_value());
+
+            if (!format)
+            {
+                std::cerr << "Unknown format: " << argv[i] << '\n';
+                return std::nullopt;
+            }
+
+            opts.format = *format;
+        }
+        else if (arg == "--nvdb-error")
+        {
+            opts.nvdb_error = std::stof(next_value());
+        }
+        else if (arg == "--nvdb-absolute")
+        {
+            opts.error_method = converter::nvdb_error_method::absolute;
+        }
+        else if (!arg.empty() && arg.front() == '-')
+        {
+            std::cerr << "Unknown option: " << arg << '\n';
+            return std::nullopt;
+        }
+        else if (opts.input_directory.empty())
+        {
+            opts.input_directory = arg;
+        }
+        else
+        {
+            std::cerr << "Unexpected argument: " << arg << '\n';
+            return std::nullopt;
+        }
+    }
+
+    if (opts.input_directory.empty())
+    {
+        std::cerr << "No input directory given.\n";
+        return std::nullopt;
+    }
+
+    return opts;
+}
+
+double mib_per_second(uintmax_t bytes, double seconds)
+{
+    return seconds > 0 ? bytes / (1024.0 * 1024.0) / seconds : 0;
+}
+
+std::vector<std::filesystem::path> find_frames(const std::filesystem::path &directory, const char *extension)
+{
+    auto files = converter::find_files_with_extension(directory, extension);
+    converter::sort_files_by_frame_number(files);
+    return files;
+}
+
+bool convert_vdb_to_nvdb(const options &opts, std::shared_ptr<utils::thread_pool> thread_pool)
+{
+    const auto files = find_frames(opts.input_directory, ".vdb");
+
+    if (files.empty())
+    {
+        std::cerr << "No .vdb files found in: " << opts.input_directory << '\n';
+        return false;
+    }
+
+    struct frame_result
+    {
+        converter::conversion_result result;
+        double seconds;
+    };
+
+    // Frames are independent, so every one of them goes to the pool
+    std::vector<std::future<frame_result>> results;
+    results.reserve(files.size());
+
+    for (const auto &file : files)
+    {
+        results.emplace_back(thread_pool->enqueue([&opts, file]() {
+            const auto t1 = std::chrono::steady_clock::now();
+            auto result = converter::convert_to_nvdb(file, opts.format, opts.nvdb_error, opts.error_method, opts.output_directory);
+            const auto t2 = std::chrono::steady_clock::now();
+
+            return frame_result{
+                .result = std::move(result),
+                .seconds = std::chrono::duration<double>(t2 - t1).count(),
+            };
+        }));
+    }
+
+    bool success = true;
+
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        const auto [result, seconds] = results[i].get();
+
+        if (!result.success)
+        {
+            std::cerr << '[' << i + 1 << '/' << files.size() << "] " << result.message << '\n';
+            success = false;
+            continue;
+        }
+
+        const auto input_size = std::filesystem::file_size(files[i]);
+
+        std::cout << '[' << i + 1 << '/' << files.size() << "] " << files[i].filename().string() << ": "
+                  << seconds * 1e3 << " ms, " << mib_per_second(input_size, seconds) << " MiB/s, error: "
+                  << result.e << " (min " << result.em << ", max " << result.ex << ")\n";
+    }
+
+    return success;
+}
+
+bool convert_nvdb_to_dvdb_gops(const options &opts, const std::vector<std::filesystem::path> &files, std::shared_ptr<utils::thread_pool> thread_pool)
+{
+    const converter::dvdb_sequence_settings settings{
+        .max_error = opts.max_error,
+        .gop_length = opts.keyframe_interval > 0 ? opts.keyframe_interval : 30,
+        .parallel_gops = opts.parallel_gops,
+        .target_frame_size = opts.target_frame_size,
+        .max_chain_length = opts.max_chain_length,
+        .scene_cut_ratio = opts.scene_cut_ratio,
+        .bidirectional_frames = opts.bidirectional_frames,
+        .reference_frames = opts.reference_frames,
+        .dct_residuals = opts.dct_residuals,
+        .output_directory = opts.output_directory,
+    };
+
+    uintmax_t total_size = 0;
+
+    for (const auto &file : files)
+    {
+        total_size += std::filesystem::file_size(file);
+    }
+
+    const auto t1 = std::chrono::steady_clock::now();
+    const auto result = converter::convert_sequence_to_dvdb(files, thread_pool, settings);
+    const auto t2 = std::chrono::steady_clock::now();
+
+    const auto seconds = std::chrono::duration<double>(t2 - t1).count();
+
+    std::cout << "Converted " << files.size() << " frames in " << seconds << " s ("
+              << mib_per_second(total_size, seconds) << " MiB/s), compression ratio: "
+              << result.compression_ratio() << '\n';
+
+    return true;
+}
+
+bool convert_nvdb_to_dvdb(const options &opts, std::shared_ptr<utils::thread_pool> thread_pool)
+{
+    const auto input_directory = opts.command == command_e::VDB_TO_DVDB && !opts.output_directory.empty() ? opts.output_directory : opts.input_directory;
+    const auto files = find_frames(input_directory, ".nvdb");
+
+    if (files.empty())
+    {
+        std::cerr << "No .nvdb files found in: " << input_directory << '\n';
+        return false;
+    }
+
+    if (opts.parallel_gops >= 0)
+    {
+        return convert_nvdb_to_dvdb_gops(opts, files, thread_pool);
+    }
+
+    converter::dvdb_converter converter(thread_pool, opts.max_error);
+    converter.set_output_directory(opts.output_directory);
+    converter.set_target_frame_size(opts.target_frame_size);
+    converter.set_keyframe_interval(opts.keyframe_interval);
+    converter.set_max_chain_length(opts.max_chain_length);
+    converter.set_scene_cut_ratio(opts.scene_cut_ratio);
+    converter.set_bidirectional_frames(opts.bidirectional_frames);
+    converter.set_reference_frames(opts.reference_frames);
+    converter.set_dct_residuals(opts.dct_residuals);
+
+    const auto total_t1 = std::chrono::steady_clock::now();
+    uintmax_t total_size = 0;
+
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        const auto input_size = std::filesystem::file_size(files[i]);
+
+        // Next frame gets decompressed while this one is encoded
+        if (i + 1 < files.size())
+        {
+            converter.prefetch_frame(files[i + 1]);
+        }
+
+        const auto t1 = std::chrono::steady_clock::now();
+        converter.add_diff_frame(files[i]);
+        const auto t2 = std::chrono::steady_clock::now();
+
+        const auto seconds = std::chrono::duration<double>(t2 - t1).count();
+        total_size += input_size;
+
+        std::cout << '[' << i + 1 << '/' << files.size() << "] " << files[i].filename().string() << ": "
+                  << seconds * 1e3 << " ms, " << mib_per_second(input_size, seconds) << " MiB/s, leaves: "
+                  << converter.current_total_leaves() << ", max error: " << converter.current_allowed_error() << '\n';
+    }
+
+    converter.flush();
+
+    // Pending LZ4 compressions still run on the pool
+    while (!converter.finished())
+    {
+        thread_pool->finish();
+    }
+
+    const auto total_t2 = std::chrono::steady_clock::now();
+    const auto total_seconds = std::chrono::duration<double>(total_t2 - total_t1).count();
+
+    std::cout << "Converted " << files.size() << " frames in " << total_seconds << " s ("
+              << mib_per_second(total_size, total_seconds) << " MiB/s), compression ratio: "
+              << converter.current_compression_ratio() << '\n';
+
+    return true;
+}
+
+bool write_container(const options &opts)
+{
+    const auto input_directory = opts.command != command_e::DVDB_TO_CONTAINER && !opts.output_directory.empty() ? opts.output_directory : opts.input_directory;
+    const auto files = find_frames(input_directory, ".dvdb");
+
+    if (files.empty())
+    {
+        std::cerr << "No .dvdb files found in: " << input_directory << '\n';
+        return false;
+    }
+
+    // Named after directory of the frames, player picks it up from there
+    const auto output_directory = opts.output_directory.empty() ? opts.input_directory : opts.output_directory;
+    const auto frames_directory = std::filesystem::absolute(input_directory).lexically_normal();
+    const auto name = frames_directory.has_filename() ? frames_directory.filename() : frames_directory.parent_path().filename();
+    const auto output = output_directory / (name.string() + ".dvdbs");
+
+    const auto size = converter::write_dvdb_container(files, output);
+
+    std::cout << "Wrote " << files.size() << " frames to " << output.string() << " (" << size << " bytes)\n";
+
+    return true;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::optional<options> opts;
+
+    try
+    {
+        opts = parse_options(argc, argv);
+    }
+    catch (std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+    }
+
+    if (!opts)
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    if (utils::get_cpu_available_feature_level() != utils::cpu_available_feature_level_e::AVX2)
+    {
+        std::cerr << "This program makes use of AVX2 instruction set. This processor doesn't support this instruction set. Sorry.\n";
+        return 1;
+    }
+
+    if (!opts->output_directory.empty())
+    {
+        std::filesystem::create_directories(opts->output_directory);
+    }
+
+    dvdb::dct_init();
+    openvdb::initialize();
+
+    auto thread_pool = std::make_shared<utils::thread_pool>(opts->thread_count);
+    bool success = true;
+
+    try
+    {
+        if (opts->command == command_e::VDB_TO_NVDB || opts->command == command_e::VDB_TO_DVDB)
+        {
+            success = convert_vdb_to_nvdb(*opts, thread_pool);
+        }
+
+        if (success && (opts->command == command_e::NVDB_TO_DVDB || opts->command == command_e::VDB_TO_DVDB))
+        {
+            success = convert_nvdb_to_dvdb(*opts, thread_pool);
+        }
+
+        if (success && (opts->command == command_e::DVDB_TO_CONTAINER || opts->container))
+        {
+            success = write_container(*opts);
+        }
+    }
+    catch (std::exception &e)
+    {
+        std::cerr << "Conversion failed: " << e.what() << '\n';
+        success = false;
+    }
+
+    thread_pool->finish();
+    openvdb::uninitialize();
+
+    return success ? 0 : 1;
+}
@@ -1,5 +1,8 @@
 #include "common.hpp"
 
+#include <algorithm>
+#include <regex>
+
 namespace converter
 {
 std::vector<std::filesystem::path> find_files_with_extension(std::filesystem::path directory, std::string extension)
@@ -18,4 +21,34 @@ std::vector<std::filesystem::path> find_files_with_extension(std::filesystem::pa
 
     return files;
 }
+
+void sort_files_by_frame_number(std::vector<std::filesystem::path> &files)
+{
+    using regex_type = std::basic_regex<std::filesystem::path::value_type>;
+
+#if VANIM_WINDOWS
+    static constexpr auto regex_pattern = L"^.*[\\/\\\\].+_(\\d+)\\.\\w+$";
+    using match_type = std::wcmatch;
+#else
+    static constexpr auto regex_pattern = "^.*[\\/\\\\].+_(\\d+)\\.\\w+$";
+    using match_type = std::cmatch;
+#endif
+
+    regex_type regex(regex_pattern);
+
+    auto path_to_frame_number = [&](const std::filesystem::path &path) -> int {
+        match_type cm;
+
+        if (std::regex_search(path.c_str(), cm, regex))
+        {
+            return std::stoi(cm[1]);
+        }
+
+        return 0;
+    };
+
+    std::sort(files.begin(), files.end(), [&](const std::filesystem::path &lhs, const std::filesystem::path &rhs) -> bool {
+        return path_to_frame_number(lhs) < path_to_frame_number(rhs);
+    });
+}
 } // namespace converter
@@ -18,4 +18,5 @@ struct conversion_result
 };
 
 std::vector<std::filesystem::path> find_files_with_extension(std::filesystem::path directory, std::string extension);
+void sort_files_by_frame_number(std::vector<std::filesystem::path> &files); // ascending, expects "<name>_<number>.<ext>"
 } // namespace converter
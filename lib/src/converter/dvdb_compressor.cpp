@@ -1,58 +1,476 @@
 #include "dvdb_compressor.hpp"
 
 #include <dvdb/compression.hpp>
+#include <dvdb/entropy.hpp>
+#include <dvdb/streams.hpp>
 #include <dvdb/types.hpp>
 #include <mio/mmap.hpp>
+#include <utils/thread_pool.hpp>
 
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
+#include <limits>
+#include <stdexcept>
 
 namespace converter
 {
-int pack_dvdb_file(const char *filename)
+namespace
 {
-    mio::mmap_source mmap(filename);
+static constexpr size_t BLOCK_SIZE = 1 << 20; // Uncompressed bytes of one independently coded block
+
+using stream_description = dvdb::headers::stream_description;
+
+struct block
+{
+    size_t stream;
+    size_t offset; // in uncompressed stream
+    stream_description description;
+    const char *data = nullptr;
+    std::vector<char> output;
+};
+
+// Without a pool everything runs here. Jobs reference locals of the caller, so all must finish before rethrowing.
+template <typename F>
+void run_blocks(size_t count, utils::thread_pool *thread_pool, F &&job)
+{
+    if (!thread_pool || count < 2)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            job(i);
+        }
+
+        return;
+    }
+
+    std::vector<std::future<void>> futures;
+    futures.reserve(count);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        futures.push_back(thread_pool->enqueue([&job, i]() { job(i); }));
+    }
+
+    thread_pool->work_together();
+
+    for (auto &future : futures)
+    {
+        future.wait();
+    }
+
+    for (auto &future : futures)
+    {
+        future.get();
+    }
+}
+
+// Tries every codec on a block and keeps the smallest output, masks and keys mostly go to LZ4, small symbols to rANS
+stream_description compress_best(const char *data, size_t size, std::vector<char> &output)
+{
+    using codec_e = stream_description::codec_e;
+
+    stream_description description{
+        .codec = codec_e::RAW,
+        .compressed_size = size,
+        .uncompressed_size = size,
+    };
+
+    output.assign(data, data + size);
+    std::vector<char> candidate(size);
+
+    const auto try_codec = [&](codec_e codec, auto compress) {
+        const int compressed = compress(data, size, candidate.data(), candidate.size());
+
+        if (compressed > 0 && compressed < description.compressed_size)
+        {
+            description.codec = codec;
+            description.compressed_size = compressed;
+            output.assign(candidate.begin(), candidate.begin() + compressed);
+        }
+    };
+
+    try_codec(codec_e::LZ4, dvdb::compress_stream);
+    try_codec(codec_e::RANS, dvdb::rans_compress_stream);
+
+    return description;
+}
+
+void decompress_block(const stream_description &description, const char *data, char *output)
+{
+    using codec_e = stream_description::codec_e;
+
+    const int size = description.uncompressed_size;
+    int decompressed = -1;
+
+    switch (description.codec)
+    {
+    case codec_e::RAW:
+        if (description.compressed_size != description.uncompressed_size)
+        {
+            break;
+        }
+
+        std::memcpy(output, data, size);
+        decompressed = size;
+        break;
+    case codec_e::LZ4:
+        decompressed = dvdb::decompress_stream(data, description.compressed_size, output, size);
+        break;
+    case codec_e::RANS:
+        decompressed = dvdb::rans_decompress_stream(data, description.compressed_size, output, size);
+        break;
+    }
+
+    if (decompressed != size)
+    {
+        throw std::runtime_error("Failed to decompress stream!");
+    }
+}
+
+struct packed_frame
+{
+    dvdb::headers::block_description header;
+    stream_description descriptions[dvdb::STREAM_COUNT]{};
+    std::vector<block> blocks;
+};
+
+packed_frame pack_frame(const char *data, size_t size, utils::thread_pool *thread_pool)
+{
+    const auto dvdb_header = reinterpret_cast<const dvdb::headers::main *>(data);
+
+    dvdb::streams streams;
+    dvdb::split_streams(data, size, streams);
+
+    packed_frame packed;
+    auto &descriptions = packed.descriptions;
+    auto &blocks = packed.blocks;
+
+    for (size_t s = 0; s < dvdb::STREAM_COUNT; ++s)
+    {
+        descriptions[s].uncompressed_size = streams[s].size();
+
+        for (size_t offset = 0; offset < streams[s].size(); offset += BLOCK_SIZE)
+        {
+            blocks.push_back({.stream = s, .offset = offset});
+            ++descriptions[s].block_count;
+        }
+    }
 
-    const auto dvdb_header = reinterpret_cast<const dvdb::headers::main *>(mmap.data());
+    run_blocks(blocks.size(), thread_pool, [&](size_t i) {
+        auto &block = blocks[i];
+        const auto &stream = streams[block.stream];
+        const auto size = std::min(BLOCK_SIZE, stream.size() - block.offset);
 
-    std::vector<char> output_buffer(mmap.size());
+        block.description = compress_best(stream.data() + block.offset, size, block.output);
+    });
 
-    int compressed = dvdb::compress_stream(mmap.data(), mmap.size(), output_buffer.data(), output_buffer.size());
+    size_t compressed = sizeof(descriptions) + blocks.size() * sizeof(stream_description);
 
-    if (compressed < 0)
+    for (const auto &block : blocks)
     {
-        throw std::runtime_error("Failed to compress stream!");
+        descriptions[block.stream].compressed_size += block.description.compressed_size;
+        compressed += block.description.compressed_size;
     }
 
-    dvdb::headers::block_description header{
-        .compressed_size = static_cast<uint64_t>(compressed),
+    packed.header = {
+        .compressed_size = compressed | dvdb::headers::block_description::SPLIT_STREAMS,
         .uncompressed_size = dvdb_header->vdb_required_size,
     };
 
+    return packed;
+}
+
+// Written next to the target and renamed over it, readers never see a partial frame
+int write_packed_frame(const char *filename, const packed_frame &packed)
+{
+    const std::filesystem::path path(filename);
+    auto temp_path = path;
+    temp_path += ".tmp";
+
+    std::error_code error;
+
+    {
+        std::ofstream file(temp_path, std::ios::binary);
+
+        file.write(reinterpret_cast<const char *>(&packed.header), sizeof(packed.header));
+        file.write(reinterpret_cast<const char *>(packed.descriptions), sizeof(packed.descriptions));
+
+        for (const auto &block : packed.blocks)
+        {
+            file.write(reinterpret_cast<const char *>(&block.description), sizeof(block.description));
+        }
+
+        for (const auto &block : packed.blocks)
+        {
+            file.write(block.output.data(), block.output.size());
+        }
+
+        if (!file.flush())
+        {
+            file.close();
+            std::filesystem::remove(temp_path, error);
+
+            throw std::runtime_error("Failed to write packed frame: " + temp_path.string());
+        }
+    }
+
+    std::filesystem::rename(temp_path, path, error);
+
+    if (error)
+    {
+        std::filesystem::remove(temp_path, error);
+
+        throw std::runtime_error("Failed to replace packed frame: " + path.string());
+    }
+
+    return static_cast<int>(packed.header.compressed_size & ~dvdb::headers::block_description::SPLIT_STREAMS);
+}
+
+void check_packed_size(const dvdb::headers::block_description *header, size_t size)
+{
+    if (size < sizeof(*header) || (header->compressed_size & ~dvdb::headers::block_description::SPLIT_STREAMS) > size - sizeof(*header))
+    {
+        throw std::runtime_error("Packed frame is truncated!");
+    }
+}
+
+// Description tables and all block data they refer to must lie within the payload, returns count of blocks with own description
+size_t check_split_streams(const char *data_begin, size_t payload_size)
+{
+    const auto *descriptions = reinterpret_cast<const stream_description *>(data_begin);
+    const auto *block_descriptions = descriptions + dvdb::STREAM_COUNT;
+
+    if (payload_size < dvdb::STREAM_COUNT * sizeof(stream_description))
+    {
+        throw std::runtime_error("Packed frame is truncated!");
+    }
+
+    size_t block_count = 0;
+
+    for (size_t s = 0; s < dvdb::STREAM_COUNT; ++s)
+    {
+        block_count += descriptions[s].block_count;
+    }
+
+    const size_t table_size = (dvdb::STREAM_COUNT + block_count) * sizeof(stream_description);
+
+    if (table_size > payload_size)
+    {
+        throw std::runtime_error("Packed frame is truncated!");
+    }
+
+    size_t remaining = payload_size - table_size;
+
+    const auto take = [&](const stream_description &description) {
+        if (description.compressed_size > remaining)
+        {
+            throw std::runtime_error("Packed frame is truncated!");
+        }
+
+        remaining -= description.compressed_size;
+    };
+
+    for (size_t s = 0; s < dvdb::STREAM_COUNT; ++s)
+    {
+        // Codecs take sizes as int, so even streams stored as a single block can't be larger
+        if (descriptions[s].block_count == 0 && descriptions[s].uncompressed_size > std::numeric_limits<int>::max())
+        {
+            throw std::runtime_error("Block is larger than allowed!");
+        }
+
+        if (descriptions[s].block_count == 0)
+        {
+            take(descriptions[s]);
+        }
+    }
+
+    for (size_t s = 0; s < dvdb::STREAM_COUNT; ++s)
+    {
+        uint64_t stream_size = 0;
+
+        for (uint32_t b = 0; b < descriptions[s].block_count; ++b, ++block_descriptions)
+        {
+            if (block_descriptions->uncompressed_size > BLOCK_SIZE)
+            {
+                throw std::runtime_error("Block is larger than allowed!");
+            }
+
+            take(*block_descriptions);
+            stream_size += block_descriptions->uncompressed_size;
+        }
+
+        if (descriptions[s].block_count != 0 && stream_size != descriptions[s].uncompressed_size)
+        {
+            throw std::runtime_error("Blocks don't add up to their stream!");
+        }
+    }
+
+    return block_count;
+}
+
+void unpack_split_streams(const char *data_begin, size_t payload_size, std::vector<char> &output, utils::thread_pool *thread_pool)
+{
+    check_split_streams(data_begin, payload_size);
+
+    const auto *descriptions = reinterpret_cast<const stream_description *>(data_begin);
+    const auto *block_descriptions = descriptions + dvdb::STREAM_COUNT;
+
+    std::vector<block> blocks;
+
+    for (size_t s = 0; s < dvdb::STREAM_COUNT; ++s)
+    {
+        if (descriptions[s].block_count == 0)
+        {
+            blocks.push_back({.stream = s, .offset = 0, .description = descriptions[s]});
+            continue;
+        }
+
+        size_t offset = 0;
+
+        for (uint32_t b = 0; b < descriptions[s].block_count; ++b)
+        {
+            blocks.push_back({.stream = s, .offset = offset, .description = *block_descriptions});
+            offset += block_descriptions->uncompressed_size;
+            ++block_descriptions;
+        }
+    }
+
+    const char *block_data = reinterpret_cast<const char *>(block_descriptions);
+
+    for (auto &block : blocks)
+    {
+        block.data = block_data;
+        block_data += block.description.compressed_size;
+    }
+
+    dvdb::streams streams;
+
+    // Key frames are only the base stream, it decompresses straight into output and join hands it back
+    const bool base_only = std::all_of(descriptions + 1, descriptions + dvdb::STREAM_COUNT, [](const stream_description &d) { return d.uncompressed_size == 0; });
+
+    if (base_only)
+    {
+        streams[static_cast<size_t>(dvdb::stream_e::BASE)].swap(output);
+    }
+
+    for (size_t s = 0; s < dvdb::STREAM_COUNT; ++s)
+    {
+        streams[s].resize(descriptions[s].uncompressed_size);
+    }
+
+    for (const auto &block : blocks)
+    {
+        if (block.offset + block.description.uncompressed_size > streams[block.stream].size())
+        {
+            throw std::runtime_error("Block lies outside of its stream!");
+        }
+    }
+
+    run_blocks(blocks.size(), thread_pool, [&](size_t i) {
+        const auto &block = blocks[i];
+        decompress_block(block.description, block.data, streams[block.stream].data() + block.offset);
+    });
+
+    dvdb::join_streams(streams, output);
+}
+} // namespace
+
+int pack_dvdb_file(const char *filename, utils::thread_pool *thread_pool)
+{
+    mio::mmap_source mmap(filename);
+
+    auto packed = pack_frame(mmap.data(), mmap.size(), thread_pool);
+
     mmap.unmap();
 
-    std::ofstream file(filename, std::ios::binary);
-    
-    file.write(reinterpret_cast<char *>(&header), sizeof(header));
-    file.write(output_buffer.data(), compressed);
+    return write_packed_frame(filename, packed);
+}
+
+int pack_dvdb_data(const char *data, size_t size, const char *filename, utils::thread_pool *thread_pool)
+{
+    return write_packed_frame(filename, pack_frame(data, size, thread_pool));
+}
 
-    return compressed;
+std::vector<char> unpack_dvdb_file(const char *filename, utils::thread_pool *thread_pool)
+{
+    std::vector<char> output;
+    unpack_dvdb_file(filename, output, thread_pool);
+    return output;
 }
 
-std::vector<char> unpack_dvdb_file(const char *filename)
+void unpack_dvdb_file(const char *filename, std::vector<char> &output, utils::thread_pool *thread_pool)
 {
     mio::mmap_source mmap(filename);
 
-    const auto *header = reinterpret_cast<const dvdb::headers::block_description *>(mmap.data());
-    const char *data_begin = mmap.data() + sizeof(*header);
+    unpack_dvdb_data(mmap.data(), mmap.size(), output, thread_pool);
+}
 
-    std::vector<char> output(header->uncompressed_size);
+std::vector<char> unpack_dvdb_data(const char *data, size_t size, utils::thread_pool *thread_pool)
+{
+    std::vector<char> output;
+    unpack_dvdb_data(data, size, output, thread_pool);
+    return output;
+}
+
+void unpack_dvdb_data(const char *data, size_t size, std::vector<char> &output, utils::thread_pool *thread_pool)
+{
+    const auto *header = reinterpret_cast<const dvdb::headers::block_description *>(data);
+    const char *data_begin = data + sizeof(*header);
+
+    check_packed_size(header, size);
+
+    if (header->compressed_size & dvdb::headers::block_description::SPLIT_STREAMS)
+    {
+        unpack_split_streams(data_begin, header->compressed_size & ~dvdb::headers::block_description::SPLIT_STREAMS, output, thread_pool);
+        return;
+    }
+
+    // Single LZ4 block of files packed before streams existed
+    output.resize(header->uncompressed_size);
     int decompressed = dvdb::decompress_stream(data_begin, header->compressed_size, output.data(), output.size());
 
     if (decompressed < 0)
     {
         throw std::runtime_error("Failed to decompress stream!");
     }
+}
 
-    return output;
+dvdb::headers::main peek_dvdb_header(const char *data, size_t size)
+{
+    const auto *header = reinterpret_cast<const dvdb::headers::block_description *>(data);
+    const char *data_begin = data + sizeof(*header);
+
+    check_packed_size(header, size);
+
+    dvdb::headers::main main_header;
+
+    if ((header->compressed_size & dvdb::headers::block_description::SPLIT_STREAMS) == 0)
+    {
+        const auto output = unpack_dvdb_data(data, size);
+        std::memcpy(&main_header, output.data(), sizeof(main_header));
+        return main_header;
+    }
+
+    const size_t block_count = check_split_streams(data_begin, header->compressed_size & ~dvdb::headers::block_description::SPLIT_STREAMS);
+
+    // Header opens the base stream, whose first block is first in block data
+    const auto *descriptions = reinterpret_cast<const stream_description *>(data_begin);
+    const auto *block_descriptions = descriptions + dvdb::STREAM_COUNT;
+
+    const auto &base = descriptions[static_cast<size_t>(dvdb::stream_e::BASE)];
+    const auto &first_block = base.block_count == 0 ? base : block_descriptions[0];
+
+    if (first_block.uncompressed_size < sizeof(main_header))
+    {
+        throw std::runtime_error("Base stream is missing the header!");
+    }
+
+    std::vector<char> output(first_block.uncompressed_size);
+    decompress_block(first_block, reinterpret_cast<const char *>(block_descriptions + block_count), output.data());
+    std::memcpy(&main_header, output.data(), sizeof(main_header));
+
+    return main_header;
 }
 } // namespace converter
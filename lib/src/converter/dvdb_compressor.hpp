@@ -1,10 +1,29 @@
 #pragma once
 
+#include <dvdb/types.hpp>
+
+#include <cstddef>
 #include <cstdint>
 #include <vector>
 
+namespace utils
+{
+class thread_pool;
+}
+
 namespace converter
 {
-int pack_dvdb_file(const char *filename);
-std::vector<char> unpack_dvdb_file(const char *filename);
+// Blocks of the file are coded on the pool when one is given
+int pack_dvdb_file(const char *filename, utils::thread_pool *thread_pool = nullptr);
+// Packs a frame assembled in memory and writes it to filename, the uncompressed frame never touches the disk
+int pack_dvdb_data(const char *data, size_t size, const char *filename, utils::thread_pool *thread_pool = nullptr);
+std::vector<char> unpack_dvdb_file(const char *filename, utils::thread_pool *thread_pool = nullptr);
+// Same for a packed frame already in memory, e.g. inside a container
+std::vector<char> unpack_dvdb_data(const char *data, size_t size, utils::thread_pool *thread_pool = nullptr);
+
+// Unpack into output, reusing its memory across frames. Key frames decompress straight into it.
+void unpack_dvdb_file(const char *filename, std::vector<char> &output, utils::thread_pool *thread_pool = nullptr);
+void unpack_dvdb_data(const char *data, size_t size, std::vector<char> &output, utils::thread_pool *thread_pool = nullptr);
+// Header of a packed frame, decodes only the block holding it
+dvdb::headers::main peek_dvdb_header(const char *data, size_t size);
 }
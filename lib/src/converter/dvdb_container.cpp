@@ -0,0 +1,118 @@
+#include "dvdb_container.hpp"
+
+#include "dvdb_compressor.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+namespace converter
+{
+namespace
+{
+static constexpr size_t FRAME_ALIGNMENT = 64; // Packed frames start on a cache line
+
+size_t align_up(size_t value)
+{
+    return (value + FRAME_ALIGNMENT - 1) & ~(FRAME_ALIGNMENT - 1);
+}
+} // namespace
+
+size_t write_dvdb_container(const std::vector<std::filesystem::path> &frames, const std::filesystem::path &output)
+{
+    dvdb::headers::container header{
+        .frame_count = frames.size(),
+        .max_uncompressed_size = 0,
+    };
+
+    std::vector<dvdb::headers::container_frame> index(frames.size());
+    size_t offset = align_up(sizeof(header) + index.size() * sizeof(index[0]));
+    uint32_t keyframe = 0;
+
+    for (size_t i = 0; i < frames.size(); ++i)
+    {
+        mio::mmap_source mmap(frames[i].string());
+
+        const auto frame_header = peek_dvdb_header(mmap.data(), mmap.size());
+
+        if (frame_header.frame_type == dvdb::headers::main::frame_type_e::KEY_FRAME)
+        {
+            keyframe = static_cast<uint32_t>(i);
+        }
+        else if (i == 0)
+        {
+            throw std::runtime_error("First frame of a container must be a key frame!");
+        }
+
+        index[i] = {
+            .offset = offset,
+            .size = mmap.size(),
+            .uncompressed_size = reinterpret_cast<const dvdb::headers::block_description *>(mmap.data())->uncompressed_size,
+            .frame_type = frame_header.frame_type,
+            .keyframe = keyframe,
+        };
+
+        header.max_uncompressed_size = std::max<uint64_t>(header.max_uncompressed_size, index[i].uncompressed_size);
+        offset = align_up(offset + mmap.size());
+    }
+
+    std::ofstream file(output, std::ios::binary);
+
+    if (!file)
+    {
+        throw std::runtime_error("Can't open container for writing: " + output.string());
+    }
+
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(index.data()), index.size() * sizeof(index[0]));
+
+    static constexpr char padding[FRAME_ALIGNMENT]{};
+
+    for (size_t i = 0; i < frames.size(); ++i)
+    {
+        file.write(padding, index[i].offset - file.tellp());
+
+        mio::mmap_source mmap(frames[i].string());
+        file.write(mmap.data(), mmap.size());
+    }
+
+    file.write(padding, offset - file.tellp());
+
+    if (!file)
+    {
+        throw std::runtime_error("Failed to write container: " + output.string());
+    }
+
+    return offset;
+}
+
+dvdb_container::dvdb_container(const std::filesystem::path &path)
+    : _mmap(path.string())
+{
+    if (_mmap.size() < sizeof(dvdb::headers::container))
+    {
+        throw std::runtime_error("DiffVDB container is truncated");
+    }
+
+    _header = reinterpret_cast<const dvdb::headers::container *>(_mmap.data());
+    _frames = reinterpret_cast<const dvdb::headers::container_frame *>(_header + 1);
+
+    if (_header->magic != dvdb::CONTAINER_MAGIC_NUMBER)
+    {
+        throw std::runtime_error("DiffVDB container magic number failed");
+    }
+
+    if (_header->frame_count == 0 || _header->frame_count > (_mmap.size() - sizeof(*_header)) / sizeof(*_frames))
+    {
+        throw std::runtime_error("DiffVDB container frame index is corrupted");
+    }
+
+    for (size_t i = 0; i < frame_count(); ++i)
+    {
+        if (_frames[i].offset > _mmap.size() || _frames[i].size > _mmap.size() - _frames[i].offset || _frames[i].keyframe > i)
+        {
+            throw std::runtime_error("DiffVDB container frame index is corrupted");
+        }
+    }
+}
+} // namespace converter
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <dvdb/types.hpp>
+#include <mio/mmap.hpp>
+
+#include <filesystem>
+#include <vector>
+
+namespace converter
+{
+// Bundles packed .dvdb frames into a single file, frames are in playback order. Returns size of the container.
+size_t write_dvdb_container(const std::vector<std::filesystem::path> &frames, const std::filesystem::path &output);
+
+// Container mapped once for the whole playback, frames are read straight from the mapping
+class dvdb_container
+{
+public:
+    explicit dvdb_container(const std::filesystem::path &path);
+
+    size_t frame_count() const
+    {
+        return _header->frame_count;
+    }
+
+    size_t max_uncompressed_size() const
+    {
+        return _header->max_uncompressed_size;
+    }
+
+    const dvdb::headers::container_frame &frame(size_t index) const
+    {
+        return _frames[index];
+    }
+
+    // Packed bytes of a frame inside the mapping, frame(index).size long
+    const char *frame_data(size_t index) const
+    {
+        return _mmap.data() + _frames[index].offset;
+    }
+
+private:
+    mio::mmap_source _mmap;
+    const dvdb::headers::container *_header = nullptr;
+    const dvdb::headers::container_frame *_frames = nullptr;
+};
+} // namespace converter
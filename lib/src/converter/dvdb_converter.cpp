@@ -8,25 +8,87 @@
 #include <dvdb/compression.hpp>
 #include <dvdb/dct.hpp>
 #include <dvdb/derivative.hpp>
+#include <dvdb/mask.hpp>
 #include <dvdb/rotate.hpp>
 #include <dvdb/statistics.hpp>
 #include <dvdb/transform.hpp>
 #include <dvdb/types.hpp>
 
 #include <utils/nvdb_mmap.hpp>
+#include <utils/scope_guard.hpp>
 #include <utils/thread_pool.hpp>
 
+#include <glm/common.hpp>
 #include <nanovdb/PNanoVDB.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstring>
+#include <exception>
 #include <fstream>
+#include <future>
+#include <map>
 #include <numeric>
+#include <sstream>
+#include <utility>
 
 #include "../test/dump.hpp"
 
 namespace converter
 {
+// Decompressed .nvdb frame with readers ready for diffing, can be loaded ahead of time
+struct nvdb_frame
+{
+    explicit nvdb_frame(const std::filesystem::path &path)
+    {
+        const auto str8 = path.string();
+        buffer = converter::unpack_nvdb_file(str8.c_str(), &alignment_correction);
+        mmap = std::make_unique<utils::nvdb_mmap>(buffer.data() + alignment_correction);
+
+        const auto is_f32 = [](const utils::nvdb_mmap::grid &grid) { return grid.type == utils::nvdb_mmap::grid::type_size::f32; };
+
+        // Other formats are only ever written as keyframes
+        if (std::all_of(mmap->grids().begin(), mmap->grids().end(), is_f32))
+        {
+            build_readers();
+        }
+    }
+
+    void build_readers()
+    {
+        readers.resize(mmap->grids().size());
+
+        for (size_t i = 0; i < readers.size(); ++i)
+        {
+            readers[i].initialize(const_cast<void *>(mmap->grids()[i].ptr));
+        }
+    }
+
+    std::vector<char> buffer;
+    int alignment_correction = 0;
+    std::unique_ptr<utils::nvdb_mmap> mmap;
+    std::vector<nvdb_reader> readers;
+};
+
+// Load queued on the pool, run by whichever side gets to it first
+struct prefetch_job
+{
+    prefetch_job(std::filesystem::path path) : load([path = std::move(path)]() { return std::make_shared<nvdb_frame>(path); }), result(load.get_future()) {}
+
+    void run()
+    {
+        if (!started.exchange(true))
+        {
+            load();
+        }
+    }
+
+    std::atomic<bool> started = false;
+    std::packaged_task<std::shared_ptr<nvdb_frame>()> load;
+    std::future<std::shared_ptr<nvdb_frame>> result;
+};
+
 struct dvdb_state
 {
     dvdb_state(float max_error) : allowed_error(max_error) {}
@@ -39,24 +101,66 @@ struct dvdb_state
     std::atomic<size_t> written_size = 0;
 
     size_t leaves_total = 0;
-    size_t leaves_processed = 0;
+    std::atomic<size_t> leaves_processed = 0;
 
     size_t pending_compressions = 0;
+    std::exception_ptr compression_error; // First failure of a packing task, guarded by status_mtx
 
-    std::vector<uint8_t> _vdb_buffer;
+    // Replaced with every anchor but never modified, so packing of key frames can share it
+    std::shared_ptr<const std::vector<uint8_t>> _vdb_buffer;
     bool previous_was_empty = true;
     double error = 0;
     int frame_number = 0;
     float expected_error = 0;
     float allowed_error = 0;
 
+    // GOP policy, each limit is disabled when 0
+    int keyframe_interval = 0;
+    int max_chain_length = 0;
+    float scene_cut_ratio = 0;
+    int frames_since_keyframe = 0;
+    int last_keyframe_number = -1;
+
+    // Anchors before the current one, most recent first, up to reference_frames - 1
+    int reference_frames = 1;
+    std::vector<std::shared_ptr<const std::vector<uint8_t>>> reference_history;
+
+    // Residuals are also tried in DCT domain, derivative coding is always tried
+    bool dct_residuals = true;
+
+    // Frames waiting for the next anchor, encoded from both sides once it's done
+    int bidirectional_frames = 0;
+    std::vector<std::pair<std::filesystem::path, std::shared_ptr<nvdb_frame>>> held_frames;
+
+    // Rate control, allowed_error is fixed when target is 0
+    size_t target_frame_size = 0;
+    std::atomic<size_t> diff_packed_input_size = 0;
+    std::atomic<size_t> diff_packed_output_size = 0;
+
+    std::filesystem::path output_directory;
+
+    // Rotation offsets chosen in previous frame, per grid and indexed like its leaves
+    std::vector<std::vector<glm::ivec3>> motion_vectors;
+
+    std::mutex prefetch_mtx;
+    std::map<std::filesystem::path, std::shared_ptr<prefetch_job>> prefetched_frames;
+
     std::ofstream file{"dvdb_cvt.csv"};
+
+    // Held frames are encoded after their anchor, their rows wait here to be written in display order
+    bool hold_csv_rows = false;
+    std::map<int, std::string> held_csv_rows;
 };
 } // namespace converter
 
 namespace
 {
 static constexpr auto FORCE_KEYFRAME_SIZE = 4096;
+static constexpr size_t LEAF_CHUNK_SIZE = 256; // Leaves encoded by a single task
+static_assert(LEAF_CHUNK_SIZE == dvdb::PREDICTOR_RESET_INTERVAL, "Chunk offsets double as bundle index");
+static constexpr size_t COARSE_MOTION_MIN_LEAVES = 64; // Lower nodes with fewer leaves aren't worth a coarse pass
+static constexpr size_t COARSE_MOTION_SAMPLES = 8;     // Leaves of a lower node scored by the coarse pass
+static constexpr int DCT_MAX_WEIGHTS = 64;              // DCT residual is only tried when fewer weights survive truncation
 
 size_t vdb_determine_leafless_copy_size_direct_ptr(const void *data)
 {
@@ -126,6 +230,20 @@ size_t vdb_get_actual_leaf_count(pnanovdb_buf_t buf, pnanovdb_tree_handle_t tree
     return count;
 }
 
+// Tasks reference locals of the caller, so none may be running anymore when an exception is rethrown
+void wait_all(std::vector<std::future<void>> &futures)
+{
+    for (auto &future : futures)
+    {
+        future.wait();
+    }
+
+    for (auto &future : futures)
+    {
+        future.get();
+    }
+}
+
 struct encoder_context
 {
     static constexpr size_t src_center_index = 13;
@@ -138,9 +256,30 @@ struct encoder_context
 
     float error = 0;
 
-    uint64_t key;
+    // Search starting points in, chosen offset out
+    dvdb::rotation_candidate rotation_candidates[3];
+    int rotation_candidate_count = 0;
+    glm::ivec3 rotation;
+
+    // Rotation of previously written leaf, offsets are stored relative to it
+    glm::ivec3 rotation_predictor{0};
+
+    bool try_dct = true;
 };
 
+// Bytes not repeating the previous one, rough stand-in for size after LZ4
+size_t estimate_packed_size(const dvdb::cube_888_i8 *values)
+{
+    size_t size = 1;
+
+    for (int i = 1; i < std::size(values->values); ++i)
+    {
+        size += values->values[i] != values->values[i - 1];
+    }
+
+    return size;
+}
+
 void vdb_encode(encoder_context *ctx, float max_error)
 {
     static constexpr float FLOAT_MAX = std::numeric_limits<float>::max();
@@ -154,13 +293,43 @@ void vdb_encode(encoder_context *ctx, float max_error)
         ctx->written += sizeof(object);
     };
 
+    // Source key is the leaf's own and never written. Deltas span [-16, 16] and are wrapped to fit 5 bits.
+    const auto write_rotation = [&](const glm::ivec3 &rotation) {
+        const auto delta = rotation - ctx->rotation_predictor;
+
+        write(dvdb::code_points::rotation_offset{
+            .x = static_cast<int16_t>(dvdb::code_points::wrap_rotation(delta.x)),
+            .y = static_cast<int16_t>(dvdb::code_points::wrap_rotation(delta.y)),
+            .z = static_cast<int16_t>(dvdb::code_points::wrap_rotation(delta.z)),
+        });
+    };
+
+    // Unchanged leaf, plain copy without any searching. Decoder treats missing source as empty leaf, which also matches.
+    const auto src_center = ctx->src_neighborhood[encoder_context::src_center_index];
+    const auto src_center_mask = ctx->src_neighborhood_masks[encoder_context::src_center_index];
+
+    if (std::memcmp(ctx->dst_mask, src_center_mask, sizeof(*ctx->dst_mask)) == 0 && std::memcmp(ctx->dst, src_center, sizeof(*ctx->dst)) == 0)
+    {
+        write(dvdb::code_points::setup{
+            .has_source = true,
+        });
+
+        *ctx->final = *ctx->dst;
+        *ctx->final_mask = *ctx->dst_mask;
+        ctx->error = 0;
+        ctx->rotation = glm::ivec3(0);
+
+        return;
+    }
+
     // determine if copy is even needed
     float error_empty = dvdb::mean_squared_error_with_mask(&empty_values_f32, ctx->dst, &ctx->dst_fmask);
 
     glm::ivec3 rotation{};
 
     // rotated source copy
-    float error_rotation_only = dvdb::rotate_refill_find_astar(ctx->dst, {}, ctx->src_neighborhood, &rotation.x, &rotation.y, &rotation.z);
+    float error_rotation_only = dvdb::rotate_refill_find_astar(ctx->dst, {}, ctx->src_neighborhood, ctx->rotation_candidates, ctx->rotation_candidate_count, &rotation.x, &rotation.y, &rotation.z);
+    ctx->rotation = rotation;
 
     dvdb::cube_888_f32 rotated, rotated_fmask;
     dvdb::cube_888_mask rotated_mask;
@@ -177,17 +346,10 @@ void vdb_encode(encoder_context *ctx, float max_error)
             .has_source = true,
             .has_rotation = rotation != glm::ivec3(0),
         });
-        write(dvdb::code_points::source_key{
-            ctx->key,
-        });
 
         if (rotation != glm::ivec3(0))
         {
-            write(dvdb::code_points::rotation_offset{
-                .x = static_cast<int16_t>(rotation.x),
-                .y = static_cast<int16_t>(rotation.y),
-                .z = static_cast<int16_t>(rotation.z),
-            });
+            write_rotation(rotation);
         }
 
         *ctx->final = rotated;
@@ -227,22 +389,14 @@ void vdb_encode(encoder_context *ctx, float max_error)
             .has_fma_and_new_mask = true,
         });
 
-        write(dvdb::code_points::source_key{
-            ctx->key,
-        });
-
         if (encodes_rotation)
         {
-            write(dvdb::code_points::rotation_offset{
-                .x = static_cast<int16_t>(rotation.x),
-                .y = static_cast<int16_t>(rotation.y),
-                .z = static_cast<int16_t>(rotation.z),
-            });
+            write_rotation(rotation);
         }
 
         write(dvdb::code_points::fma::from_float(fadd, fmul));
 
-        write(*ctx->dst_mask);
+        ctx->written += dvdb::encode_mask(&rotated_mask, ctx->dst_mask, ctx->buffer + ctx->written);
 
         *ctx->final = rotated_fma;
         *ctx->final_mask = rotated_mask;
@@ -251,32 +405,124 @@ void vdb_encode(encoder_context *ctx, float max_error)
         return;
     }
 
-    dvdb::cube_888_i8 diff8;
-    dvdb::cube_888_f32 diff, diff_decoded;
-    float min, max, error_diff;
-    uint8_t quantization;
+    dvdb::cube_888_f32 diff;
 
     dvdb::sub(ctx->dst, &rotated_fma, &diff);
 
-    dvdb::cube_888_f32 post_diff;
+    // Residual coding modes only differ in how diff is turned into bytes and back
+    struct residual_candidate
+    {
+        bool has_derivative = false;
+        bool has_dct = false;
+        uint8_t quantization = 0;
+        float min = 0, max = 0;
+        float error = FLOAT_MAX;
+        dvdb::cube_888_i8 values;
+        dvdb::cube_888_f32 reconstructed;
+    };
+
+    const auto find_quantization = [&](residual_candidate &candidate, auto &&code) {
+        const auto try_quantization = [&](uint8_t q) {
+            candidate.quantization = q;
+
+            dvdb::cube_888_f32 decoded;
+            code(q, &candidate, &decoded);
+
+            dvdb::add(&decoded, &rotated_fma, &candidate.reconstructed);
+
+            candidate.error = dvdb::mean_squared_error_with_mask(&candidate.reconstructed, ctx->dst, &ctx->dst_fmask);
+
+            return candidate.error <= max_error;
+        };
+
+        // Error falls (almost) monotonically with quantization, so bisect for the lowest level that fits
+        // instead of trying all of them. Only levels that actually passed are ever selected.
+        static constexpr int QUANTIZATION_MIN = 0x02, QUANTIZATION_MAX = 0xfe;
+
+        if (try_quantization(QUANTIZATION_MAX))
+        {
+            int lo = QUANTIZATION_MIN - 1, hi = QUANTIZATION_MAX;
+
+            while (hi - lo > 1)
+            {
+                const int mid = (lo + hi) / 2;
+                (try_quantization(mid) ? hi : lo) = mid;
+            }
+
+            if (candidate.quantization != hi)
+            {
+                try_quantization(hi);
+            }
+        }
+    };
+
+    residual_candidate candidates[3];
+    int candidate_count = 0;
+
+    {
+        auto &raw = candidates[candidate_count++];
+
+        find_quantization(raw, [&](uint8_t q, residual_candidate *c, dvdb::cube_888_f32 *decoded) {
+            dvdb::encode_to_i8(&diff, &c->values, &c->max, &c->min, q);
+            dvdb::decode_from_i8(&c->values, decoded, c->max, c->min, q);
+        });
+    }
+
+    {
+        auto &derivative = candidates[candidate_count++];
+        derivative.has_derivative = true;
+
+        find_quantization(derivative, [&](uint8_t q, residual_candidate *c, dvdb::cube_888_f32 *decoded) {
+            dvdb::encode_derivative_to_i8(&diff, &c->values, &c->max, &c->min, q);
+            dvdb::decode_derivative_from_i8(&c->values, decoded, c->max, c->min, q);
+        });
+    }
 
-    for (int i = 0x02; i <= 0xfe; ++i)
+    if (ctx->try_dct)
     {
-        quantization = i;
+        // Half of error budget goes to dropped weights, the rest to their quantization
+        dvdb::cube_888_f32 weights;
+        dvdb::dct_3d_encode(&diff, &weights);
+
+        // Noisy residuals keep most weights, those are cheaper as raw values and slow to evaluate
+        if (dvdb::dct_3d_truncate(&weights, max_error * 0.5f) <= DCT_MAX_WEIGHTS)
+        {
+            auto &dct = candidates[candidate_count++];
+            dct.has_dct = true;
 
-        dvdb::encode_to_i8(&diff, &diff8, &max, &min, quantization);
-        dvdb::decode_from_i8(&diff8, &diff_decoded, max, min, quantization);
+            find_quantization(dct, [&](uint8_t q, residual_candidate *c, dvdb::cube_888_f32 *decoded) {
+                dvdb::cube_888_f32 decoded_weights;
 
-        dvdb::add(&diff_decoded, &rotated_fma, &post_diff);
+                dvdb::encode_to_i8(&weights, &c->values, &c->max, &c->min, q);
+                dvdb::decode_from_i8(&c->values, &decoded_weights, c->max, c->min, q);
+                dvdb::dct_snap_to_zero(&decoded_weights, (c->max - c->min) / q);
+                dvdb::dct_3d_decode(&decoded_weights, decoded);
+            });
+        }
+    }
+
+    // All modes write the same number of bytes, so smallest is the one LZ4 packs best.
+    // If none fits error budget, the most precise one is used.
+    const auto fits = [&](const residual_candidate &c) { return c.error <= max_error; };
 
-        error_diff = dvdb::mean_squared_error_with_mask(&post_diff, ctx->dst, &ctx->dst_fmask);
+    int best = 0;
 
-        if (error_diff <= max_error)
+    for (int i = 1; i < candidate_count; ++i)
+    {
+        const auto &c = candidates[i], &b = candidates[best];
+
+        if (fits(c) && (!fits(b) || estimate_packed_size(&c.values) < estimate_packed_size(&b.values)))
+        {
+            best = i;
+        }
+        else if (!fits(c) && !fits(b) && c.error < b.error)
         {
-            break;
+            best = i;
         }
     }
 
+    const auto &residual = candidates[best];
+
     // Most elaborate encoding
     {
         write(dvdb::code_points::setup{
@@ -285,122 +531,206 @@ void vdb_encode(encoder_context *ctx, float max_error)
             .has_fma_and_new_mask = true,
             .has_values = true,
             .has_diff = true,
-            .has_derivative = false,
-            .has_dct = false,
+            .has_derivative = residual.has_derivative,
+            .has_dct = residual.has_dct,
             .has_map = true,
         });
 
-        write(dvdb::code_points::source_key{
-            ctx->key,
-        });
-
         if (rotation != glm::ivec3(0))
         {
-            write(dvdb::code_points::rotation_offset{
-                .x = static_cast<int16_t>(rotation.x),
-                .y = static_cast<int16_t>(rotation.y),
-                .z = static_cast<int16_t>(rotation.z),
-            });
+            write_rotation(rotation);
         }
 
         write(dvdb::code_points::fma::from_float(fadd, fmul));
 
-        write(*ctx->dst_mask);
+        ctx->written += dvdb::encode_mask(&rotated_mask, ctx->dst_mask, ctx->buffer + ctx->written);
 
         write(dvdb::code_points::quantization{
-            quantization,
+            residual.quantization,
         });
 
         write(dvdb::code_points::map{
-            .min = min,
-            .max = max,
+            .min = residual.min,
+            .max = residual.max,
         });
 
-        write(diff8);
+        write(residual.values);
 
-        *ctx->final = post_diff;
+        *ctx->final = residual.reconstructed;
         *ctx->final_mask = *ctx->dst_mask;
-        ctx->error = error_diff;
+        ctx->error = residual.error;
 
         return;
     }
 }
 
-std::vector<uint8_t> vdb_create_rle_diff(const void *src_state, const void *dst_state, void *final_state, converter::dvdb_state *state, std::shared_ptr<utils::thread_pool> thread_pool)
+// Three step search of one offset shared by sampled leaves of each lower node (16^3 leaves), per leaf result
+std::vector<glm::ivec3> vdb_estimate_coarse_motion(const converter::nvdb_reader &src_reader, const converter::nvdb_reader &dst_reader, utils::thread_pool *thread_pool)
 {
-    const float max_error_base = state->allowed_error;
-
-    converter::nvdb_reader src_reader{}, dst_reader{}, final_reader{};
-
-    src_reader.initialize(const_cast<void *>(src_state));
-    dst_reader.initialize(const_cast<void *>(dst_state));
-    final_reader.initialize(final_state);
-
-    state->leaves_total = dst_reader.leaf_count();
-    state->leaves_processed = 0;
+    static constexpr int SEARCH_LIMIT = 7;
 
-    std::vector<uint8_t> output_data;
+    const size_t leaf_count = dst_reader.leaf_count();
 
-    dvdb::cube_888_f32 empty_values{};
-    dvdb::cube_888_mask empty_mask{};
-
-    float min = 1e12, max = -1e12;
+    std::vector<glm::ivec3> coarse_motion(leaf_count, glm::ivec3(0));
+    std::vector<std::pair<uint64_t, int>> lower_leaves(leaf_count);
 
+    for (size_t i = 0; i < leaf_count; ++i)
     {
-        std::lock_guard lock(state->status_mtx);
-        state->status_string = "Adjusting expected error...";
+        lower_leaves[i] = {converter::nvdb_reader::ivec3_to_key(dst_reader.leaf_coord(i) >> 4), static_cast<int>(i)};
     }
 
-    for (int i = 0; i < dst_reader.leaf_count(); ++i)
+    std::sort(lower_leaves.begin(), lower_leaves.end());
+
+    std::vector<std::future<void>> work_finished;
+
+    for (size_t begin = 0, end = 0; begin < leaf_count; begin = end)
     {
-        const auto leaf_data = dst_reader.leaf_table_ptr(i);
+        for (end = begin; end < leaf_count && lower_leaves[end].first == lower_leaves[begin].first; ++end)
+        {
+        }
 
-        for (int j = 0; j < std::size(leaf_data->values); ++j)
+        if (end - begin < COARSE_MOTION_MIN_LEAVES)
         {
-            const auto value = leaf_data->values[j];
+            continue;
+        }
 
-            if (value < min)
+        work_finished.emplace_back(thread_pool->enqueue([&, begin, end]() {
+            dvdb::cube_888_f32 empty_values{};
+            dvdb::cube_888_mask empty_mask{};
+
+            struct sample
             {
-                min = value;
+                dvdb::cube_888_f32 *dst, dst_fmask, *neighborhood[27];
+                dvdb::cube_888_mask *neighborhood_masks[27];
+            };
+
+            std::vector<sample> samples(COARSE_MOTION_SAMPLES);
+
+            for (size_t s = 0; s < samples.size(); ++s)
+            {
+                const int i = lower_leaves[begin + s * (end - begin) / samples.size()].second;
+
+                samples[s].dst = dst_reader.leaf_table_ptr(i);
+                samples[s].dst_fmask = dst_reader.leaf_bitmask_ptr(i)->as_values<float, 1, 0>();
+
+                src_reader.leaf_neighbors(dst_reader.leaf_coord(i), samples[s].neighborhood, samples[s].neighborhood_masks, &empty_values, &empty_mask);
             }
 
-            if (value > max)
+            const auto cost = [&](glm::ivec3 offset) {
+                dvdb::cube_888_f32 rotated;
+                float total = 0;
+
+                for (auto &s : samples)
+                {
+                    float pre_fma_error, post_fma_error;
+
+                    dvdb::rotate_refill(&rotated, s.neighborhood, offset.x, offset.y, offset.z);
+                    dvdb::linear_regression_errors_with_mask(&rotated, s.dst, &s.dst_fmask, &pre_fma_error, &post_fma_error);
+
+                    total += std::min(pre_fma_error, post_fma_error);
+                }
+
+                return total;
+            };
+
+            glm::ivec3 center(0);
+            float best = cost(center);
+
+            for (int step = 4; step >= 1; step /= 2)
             {
-                max = value;
+                glm::ivec3 next = center;
+
+                for (int z = -1; z <= 1; ++z)
+                {
+                    for (int y = -1; y <= 1; ++y)
+                    {
+                        for (int x = -1; x <= 1; ++x)
+                        {
+                            const auto offset = glm::clamp(center + glm::ivec3(x, y, z) * step, glm::ivec3(-SEARCH_LIMIT), glm::ivec3(SEARCH_LIMIT));
+
+                            if (offset == center)
+                            {
+                                continue;
+                            }
+
+                            if (const float error = cost(offset); error < best)
+                            {
+                                best = error, next = offset;
+                            }
+                        }
+                    }
+                }
+
+                center = next;
             }
-        }
 
-        ++state->leaves_processed;
+            for (size_t j = begin; j < end; ++j)
+            {
+                coarse_motion[lower_leaves[j].second] = center;
+            }
+        }));
     }
 
-    state->leaves_processed = 0;
+    thread_pool->work_together();
+    wait_all(work_finished);
+
+    return coarse_motion;
+}
+
+// Scales allowed error by how far estimated compressed size of the last diff frame is from target
+void rate_control_update(converter::dvdb_state *state, size_t uncompressed_size)
+{
+    static constexpr float MIN_ERROR = 1e-8f; // Lets control move away from lossless
+    static constexpr float MAX_STEP = 2.f;
 
+    if (state->target_frame_size == 0)
     {
-        std::lock_guard lock(state->status_mtx);
-        state->status_string = "Dispatching leaf data processing...";
+        return;
     }
 
-    std::vector<encoder_context> thread_contexts(dst_reader.leaf_count());
-    std::vector<std::future<void>> work_finished(dst_reader.leaf_count());
+    // Packing runs behind encoding, so LZ4 ratio comes from a few frames earlier
+    const size_t packed_input = state->diff_packed_input_size;
+    const size_t packed_output = state->diff_packed_output_size;
+    const double lz4_ratio = packed_output > 0 ? static_cast<double>(packed_input) / packed_output : 1.0;
 
-    for (int i = 0; i < dst_reader.leaf_count(); ++i)
+    const double estimated_size = uncompressed_size / lz4_ratio;
+
+    // Square root damps oscillation between calm and turbulent frames
+    const float step = std::clamp(static_cast<float>(std::sqrt(estimated_size / state->target_frame_size)), 1.f / MAX_STEP, MAX_STEP);
+
+    state->allowed_error = std::max(state->allowed_error * step, MIN_ERROR);
+}
+
+struct chunk_result
+{
+    std::vector<uint8_t> data;
+    double error = 0;
+};
+
+// Encodes leaves in chunks spread over the pool, then joins chunk outputs in leaf order. Offset of every chunk goes to bundle_offsets.
+template <typename F>
+std::vector<uint8_t> vdb_encode_leaf_chunks(size_t leaf_count, converter::dvdb_state *state, utils::thread_pool *thread_pool, std::vector<uint64_t> *bundle_offsets, F &&encode_chunk)
+{
     {
-        auto &ctx = thread_contexts[i];
+        std::lock_guard lock(state->status_mtx);
+        state->status_string = "Dispatching leaf data processing...";
+    }
 
-        ctx.dst_mask = dst_reader.leaf_bitmask_ptr(i);
-        ctx.dst = dst_reader.leaf_table_ptr(i);
-        ctx.dst_fmask = ctx.dst_mask->as_values<float, 1, 0>();
+    const size_t chunk_count = (leaf_count + LEAF_CHUNK_SIZE - 1) / LEAF_CHUNK_SIZE;
 
-        ctx.final_mask = final_reader.leaf_bitmask_ptr(i);
-        ctx.final = final_reader.leaf_table_ptr(i);
-        ctx.key = dst_reader.leaf_key(i);
-        ctx.written = 0;
+    std::vector<chunk_result> chunks(chunk_count);
+    std::vector<std::future<void>> work_finished(chunk_count);
 
-        src_reader.leaf_neighbors(dst_reader.leaf_coord(i), ctx.src_neighborhood, ctx.src_neighborhood_masks, &empty_values, &empty_mask);
+    for (size_t c = 0; c < chunk_count; ++c)
+    {
+        work_finished[c] = thread_pool->enqueue([&, c]() {
+            const size_t begin = c * LEAF_CHUNK_SIZE;
+            const size_t end = std::min(begin + LEAF_CHUNK_SIZE, leaf_count);
 
-        work_finished[i] = thread_pool->enqueue([ctx_ptr = &ctx, max_error_base]() { vdb_encode(ctx_ptr, max_error_base); });
+            encode_chunk(begin, end, chunks[c]);
 
-        ++state->leaves_processed;
+            state->leaves_processed += end - begin;
+        });
     }
 
     {
@@ -409,245 +739,839 @@ std::vector<uint8_t> vdb_create_rle_diff(const void *src_state, const void *dst_
     }
 
     thread_pool->work_together();
+    wait_all(work_finished);
 
     {
         std::lock_guard lock(state->status_mtx);
         state->status_string = "Finished! Acquiring processed data...";
     }
 
-    state->leaves_processed = 0;
     state->error = 0;
 
-    for (int i = 0; i < dst_reader.leaf_count(); ++i)
+    std::vector<size_t> chunk_offsets(chunk_count + 1, 0);
+
+    for (size_t c = 0; c < chunk_count; ++c)
     {
-        work_finished[i].get();
-        const auto &ctx = thread_contexts[i];
+        chunk_offsets[c + 1] = chunk_offsets[c] + chunks[c].data.size();
+        state->error += chunks[c].error;
+    }
 
-        if (ctx.written > sizeof(ctx.buffer))
-        {
-            throw std::runtime_error("Buffer overrun when writing encoded data!");
-        }
+    std::vector<uint8_t> output_data(chunk_offsets.back());
 
-        std::copy_n(ctx.buffer, ctx.written, std::back_inserter(output_data));
-        ++state->leaves_processed;
-        state->error += ctx.error;
+    for (size_t c = 0; c < chunk_count; ++c)
+    {
+        work_finished[c] = thread_pool->enqueue([&, c]() {
+            std::copy(chunks[c].data.begin(), chunks[c].data.end(), output_data.begin() + chunk_offsets[c]);
+            std::vector<uint8_t>().swap(chunks[c].data);
+        });
     }
 
-    const auto error_result = converter::calculate_error(std::move(dst_reader), std::move(final_reader));
+    thread_pool->work_together();
+    wait_all(work_finished);
 
-    state->file << state->frame_number << ';'
-                << error_result.error << ';'
-                << error_result.min_error << ';'
-                << error_result.max_error << '\n';
+    bundle_offsets->assign(chunk_offsets.begin(), chunk_offsets.end() - 1);
 
     return output_data;
 }
-} // namespace
 
-namespace converter
+void vdb_log_row(converter::dvdb_state *state, double error, double min_error, double max_error)
 {
-dvdb_converter::dvdb_converter(std::shared_ptr<utils::thread_pool> pool, float max_error)
-    : _thread_pool(std::move(pool)), _state(std::make_unique<dvdb_state>(max_error))
-{
-}
+    std::ostringstream row;
 
-dvdb_converter::~dvdb_converter() = default;
+    if (state->frame_number == 0)
+    {
+        row << "frame;error;min_error;max_error\n";
+    }
 
-std::string dvdb_converter::current_processing_step()
-{
-    std::lock_guard lock(_state->status_mtx);
-    return _state->status_string;
-}
+    row << state->frame_number << ';'
+        << error << ';'
+        << min_error << ';'
+        << max_error << '\n';
 
-std::string dvdb_converter::current_compression_step()
-{
-    std::lock_guard lock(_state->status_mtx);
-    return _state->compression_string;
+    if (state->hold_csv_rows)
+    {
+        state->held_csv_rows[state->frame_number] += row.str();
+    }
+    else
+    {
+        state->file << row.str();
+    }
 }
 
-void dvdb_converter::set_status(std::string str)
+void vdb_log_frame_error(const converter::nvdb_reader &dst_reader, const converter::nvdb_reader &final_reader, converter::dvdb_state *state)
 {
-    std::lock_guard lock(_state->status_mtx);
-    _state->status_string = std::move(str);
-}
+    const auto error_result = converter::calculate_error(dst_reader, final_reader);
 
-void dvdb_converter::change_compression_status(int diff)
-{
-    std::lock_guard lock(_state->status_mtx);
-    _state->pending_compressions += diff;
-    _state->compression_string = "Pending files to compress (LZ4): " + std::to_string(_state->pending_compressions);
+    vdb_log_row(state, error_result.error, error_result.min_error, error_result.max_error);
 }
 
-void dvdb_converter::create_keyframe(std::filesystem::path path)
+// Older states are anchors before src_state, when given every leaf codes which one it's predicted from
+std::vector<uint8_t> vdb_create_rle_diff(const void *src_state, const std::vector<const void *> &older_states, const converter::nvdb_reader &dst_reader, void *final_state, std::vector<glm::ivec3> *motion_vectors, std::vector<uint64_t> *bundle_offsets, converter::dvdb_state *state, std::shared_ptr<utils::thread_pool> thread_pool)
 {
-    set_status("Rewriting keyframe:\n  " + path.string());
-
-    int alignment_correction = 0;
-    const auto str8 = path.string();
-    const auto nvdb_buffer = converter::unpack_nvdb_file(str8.c_str(), &alignment_correction);
+    const float max_error_base = state->allowed_error;
 
-    utils::nvdb_mmap nvdb_mmap(nvdb_buffer.data() + alignment_correction);
-    _state->read_size += nvdb_mmap.mem_size();
+    converter::nvdb_reader src_reader{}, final_reader{};
+    std::vector<converter::nvdb_reader> older_readers(older_states.size());
 
-    auto dvdb_path = path;
-    dvdb_path.replace_extension(".dvdb");
+    src_reader.initialize(const_cast<void *>(src_state));
+    final_reader.initialize(final_state);
 
+    for (size_t r = 0; r < older_states.size(); ++r)
     {
-        dvdb::headers::main header = {
-            .magic = dvdb::MAGIC_NUMBER,
-            .frame_type = dvdb::headers::main::frame_type_e::KEY_FRAME,
-            .vdb_grid_count = nvdb_mmap.grids().size(),
-            .vdb_required_size = sizeof(header),
-            .frames = {},
-        };
+        older_readers[r].initialize(const_cast<void *>(older_states[r]));
+    }
 
-        for (size_t i = 0; i < nvdb_mmap.grids().size(); ++i)
-        {
-            const auto &grid = nvdb_mmap.grids()[i];
+    const size_t reference_count = 1 + older_readers.size();
 
-            header.frames[i].base_tree_offset_start = header.vdb_required_size;
-            header.frames[i].base_tree_copy_size = grid.size;
-            header.frames[i].base_tree_final_size = grid.size;
-            header.vdb_required_size += grid.size;
-        }
+    state->leaves_total = dst_reader.leaf_count();
+    state->leaves_processed = 0;
 
-        std::ofstream output(dvdb_path.string(), std::ios::binary);
+    dvdb::cube_888_f32 empty_values{};
+    dvdb::cube_888_mask empty_mask{};
 
-        output.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    float min = 1e12, max = -1e12;
 
-        for (size_t i = 0; i < nvdb_mmap.grids().size(); ++i)
-        {
-            const auto &grid = nvdb_mmap.grids()[i];
+    {
+        std::lock_guard lock(state->status_mtx);
+        state->status_string = "Adjusting expected error...";
+    }
 
-            output.write(reinterpret_cast<const char *>(grid.ptr), grid.size);
-        }
+    for (int i = 0; i < dst_reader.leaf_count(); ++i)
+    {
+        const auto leaf_data = dst_reader.leaf_table_ptr(i);
 
-        if (header.vdb_required_size < FORCE_KEYFRAME_SIZE)
+        for (int j = 0; j < std::size(leaf_data->values); ++j)
         {
-            _state->previous_was_empty = true;
+            const auto value = leaf_data->values[j];
+
+            if (value < min)
+            {
+                min = value;
+            }
+
+            if (value > max)
+            {
+                max = value;
+            }
         }
+
+        ++state->leaves_processed;
     }
 
-    set_status("Verifying:\n  " + dvdb_path.string());
+    state->leaves_processed = 0;
+
+    const size_t leaf_count = dst_reader.leaf_count();
 
-    // Briefly verify contents and update current state
     {
-        mio::mmap_source input(dvdb_path.string());
+        std::lock_guard lock(state->status_mtx);
+        state->status_string = "Estimating coarse motion...";
+    }
 
-        const auto header = reinterpret_cast<const dvdb::headers::main *>(input.data());
+    const auto coarse_motion_vectors = vdb_estimate_coarse_motion(src_reader, dst_reader, thread_pool.get());
 
-        if (header->magic != dvdb::MAGIC_NUMBER)
+    // Source tree has the same leaves as previous frame's destination, so its indices match previous motion vectors
+    const std::vector<glm::ivec3> previous_motion_vectors = std::move(*motion_vectors);
+    motion_vectors->assign(leaf_count, glm::ivec3(0));
+
+    auto output_data = vdb_encode_leaf_chunks(leaf_count, state, thread_pool.get(), bundle_offsets, [&](size_t begin, size_t end, chunk_result &chunk) {
+        // Scratch is reused for every leaf of the chunk, only encoded bytes are kept
+        encoder_context contexts[dvdb::MAX_REFERENCE_FRAMES];
+        dvdb::cube_888_f32 finals[dvdb::MAX_REFERENCE_FRAMES];
+        dvdb::cube_888_mask final_masks[dvdb::MAX_REFERENCE_FRAMES];
+
+        for (auto &ctx : contexts)
         {
-            throw std::runtime_error("DVDB header magic mismatch!");
+            ctx.try_dct = state->dct_residuals;
         }
 
-        uint64_t current_offset = sizeof(*header);
+        glm::ivec3 previous_rotation(0);
+
+        for (size_t i = begin; i < end; ++i)
+        {
+            for (size_t r = 0; r < reference_count; ++r)
+            {
+                auto &ctx = contexts[r];
+                const auto &reader = r == 0 ? src_reader : older_readers[r - 1];
+
+                ctx.rotation_candidate_count = 0;
+                ctx.rotation_predictor = i % dvdb::PREDICTOR_RESET_INTERVAL == 0 ? glm::ivec3(0) : previous_rotation;
+
+                // Spatial predictor, leaves are sorted by key so previous one is usually adjacent
+                if (i > begin)
+                {
+                    ctx.rotation_candidates[ctx.rotation_candidate_count++] = {ctx.rotation.x, ctx.rotation.y, ctx.rotation.z};
+                }
+
+                // Motion vectors and coarse motion only describe the step from previous anchor
+                if (r == 0)
+                {
+                    // Temporal predictor
+                    if (const int previous = src_reader.get_leaf_index_from_key(dst_reader.leaf_key(i)); previous >= 0 && static_cast<size_t>(previous) < previous_motion_vectors.size())
+                    {
+                        const auto &mv = previous_motion_vectors[previous];
+                        ctx.rotation_candidates[ctx.rotation_candidate_count++] = {mv.x, mv.y, mv.z};
+                    }
+
+                    // Bulk motion of the whole lower node
+                    if (const auto &mv = coarse_motion_vectors[i]; mv != glm::ivec3(0))
+                    {
+                        ctx.rotation_candidates[ctx.rotation_candidate_count++] = {mv.x, mv.y, mv.z};
+                    }
+                }
+
+                ctx.dst_mask = dst_reader.leaf_bitmask_ptr(i);
+                ctx.dst = dst_reader.leaf_table_ptr(i);
+                ctx.dst_fmask = r == 0 ? ctx.dst_mask->as_values<float, 1, 0>() : contexts[0].dst_fmask;
+
+                // Single reference writes straight into final state, otherwise the chosen one is copied there
+                ctx.final_mask = reference_count == 1 ? final_reader.leaf_bitmask_ptr(i) : &final_masks[r];
+                ctx.final = reference_count == 1 ? final_reader.leaf_table_ptr(i) : &finals[r];
+
+                reader.leaf_neighbors(dst_reader.leaf_coord(i), ctx.src_neighborhood, ctx.src_neighborhood_masks, &empty_values, &empty_mask);
+
+                vdb_encode(&ctx, max_error_base);
+
+                if (ctx.written > sizeof(ctx.buffer))
+                {
+                    throw std::runtime_error("Buffer overrun when writing encoded data!");
+                }
+            }
+
+            size_t best = 0;
+
+            for (size_t r = 1; r < reference_count; ++r)
+            {
+                if (contexts[r].written < contexts[best].written || (contexts[r].written == contexts[best].written && contexts[r].error < contexts[best].error))
+                {
+                    best = r;
+                }
+            }
+
+            const auto &ctx = contexts[best];
+
+            if (reference_count == 1)
+            {
+                chunk.data.insert(chunk.data.end(), ctx.buffer, ctx.buffer + ctx.written);
+            }
+            else
+            {
+                const dvdb::code_points::reference_index reference{static_cast<uint8_t>(best)};
+                const auto reference_ptr = reinterpret_cast<const uint8_t *>(&reference);
+
+                // Reference goes right after setup
+                chunk.data.insert(chunk.data.end(), ctx.buffer, ctx.buffer + sizeof(dvdb::code_points::setup));
+                chunk.data.insert(chunk.data.end(), reference_ptr, reference_ptr + sizeof(reference));
+                chunk.data.insert(chunk.data.end(), ctx.buffer + sizeof(dvdb::code_points::setup), ctx.buffer + ctx.written);
+
+                *final_reader.leaf_table_ptr(i) = finals[best];
+                *final_reader.leaf_bitmask_ptr(i) = final_masks[best];
+            }
+
+            chunk.error += ctx.error;
+            previous_rotation = ctx.rotation;
+            (*motion_vectors)[i] = contexts[0].rotation;
+        }
+    });
+
+    // Error is logged by the caller, frame might still turn into a keyframe
+    return output_data;
+}
+
+std::vector<uint8_t> vdb_create_bidirectional_diff(const void *previous_state, const void *next_state, const converter::nvdb_reader &dst_reader, void *final_state, std::vector<uint64_t> *bundle_offsets, converter::dvdb_state *state, std::shared_ptr<utils::thread_pool> thread_pool)
+{
+    using source_e = dvdb::code_points::reference::source_e;
+
+    static constexpr int PREVIOUS = static_cast<int>(source_e::PREVIOUS);
+    static constexpr int NEXT = static_cast<int>(source_e::NEXT);
+    static constexpr int AVERAGE = static_cast<int>(source_e::AVERAGE);
+
+    const float max_error_base = state->allowed_error;
+
+    converter::nvdb_reader previous_reader{}, next_reader{}, final_reader{};
 
-        for (size_t i = 0; i < header->vdb_grid_count; ++i)
+    previous_reader.initialize(const_cast<void *>(previous_state));
+    next_reader.initialize(const_cast<void *>(next_state));
+    final_reader.initialize(final_state);
+
+    state->leaves_total = dst_reader.leaf_count();
+    state->leaves_processed = 0;
+
+    dvdb::cube_888_f32 empty_values{};
+    dvdb::cube_888_mask empty_mask{};
+
+    auto output_data = vdb_encode_leaf_chunks(dst_reader.leaf_count(), state, thread_pool.get(), bundle_offsets, [&](size_t begin, size_t end, chunk_result &chunk) {
+        // One context per reference, indexed by source_e
+        encoder_context contexts[3];
+        dvdb::cube_888_f32 finals[3];
+        dvdb::cube_888_mask final_masks[3];
+
+        for (auto &ctx : contexts)
         {
-            auto &frame = header->frames[i];
+            ctx.try_dct = state->dct_residuals;
+        }
+
+        auto average_values = std::make_unique<dvdb::cube_888_f32[]>(27);
+        auto average_masks = std::make_unique<dvdb::cube_888_mask[]>(27);
 
-            if (frame.base_tree_offset_start != current_offset)
+        glm::ivec3 previous_rotation(0);
+
+        for (size_t i = begin; i < end; ++i)
+        {
+            for (int r = 0; r < 3; ++r)
             {
-                throw std::runtime_error("Grid offset mismatch!");
+                auto &ctx = contexts[r];
+
+                ctx.rotation_candidate_count = 0;
+                ctx.rotation_predictor = i % dvdb::PREDICTOR_RESET_INTERVAL == 0 ? glm::ivec3(0) : previous_rotation;
+
+                if (i > begin)
+                {
+                    ctx.rotation_candidates[ctx.rotation_candidate_count++] = {ctx.rotation.x, ctx.rotation.y, ctx.rotation.z};
+                }
+
+                ctx.dst_mask = dst_reader.leaf_bitmask_ptr(i);
+                ctx.dst = dst_reader.leaf_table_ptr(i);
+
+                ctx.final_mask = &final_masks[r];
+                ctx.final = &finals[r];
             }
 
-            if (frame.base_tree_copy_size != frame.base_tree_final_size)
+            contexts[PREVIOUS].dst_fmask = contexts[PREVIOUS].dst_mask->as_values<float, 1, 0>();
+            contexts[NEXT].dst_fmask = contexts[PREVIOUS].dst_fmask;
+            contexts[AVERAGE].dst_fmask = contexts[PREVIOUS].dst_fmask;
+
+            previous_reader.leaf_neighbors(dst_reader.leaf_coord(i), contexts[PREVIOUS].src_neighborhood, contexts[PREVIOUS].src_neighborhood_masks, &empty_values, &empty_mask);
+            next_reader.leaf_neighbors(dst_reader.leaf_coord(i), contexts[NEXT].src_neighborhood, contexts[NEXT].src_neighborhood_masks, &empty_values, &empty_mask);
+
+            // Must match decoder exactly, it rebuilds the same neighbourhood
+            for (int n = 0; n < 27; ++n)
             {
-                throw std::runtime_error("Grid size mismatch!");
+                dvdb::average(contexts[PREVIOUS].src_neighborhood[n], contexts[NEXT].src_neighborhood[n], &average_values[n]);
+                average_masks[n].values = contexts[PREVIOUS].src_neighborhood_masks[n]->values | contexts[NEXT].src_neighborhood_masks[n]->values;
+
+                contexts[AVERAGE].src_neighborhood[n] = &average_values[n];
+                contexts[AVERAGE].src_neighborhood_masks[n] = &average_masks[n];
             }
 
-            const auto magic_address = reinterpret_cast<const uint64_t *>(input.data() + current_offset);
+            int best = PREVIOUS;
 
-            if (*magic_address != PNANOVDB_MAGIC_NUMBER)
+            for (int r = 0; r < 3; ++r)
             {
-                throw std::runtime_error("NanoVDB magic mismatch!");
+                vdb_encode(&contexts[r], max_error_base);
+
+                if (contexts[r].written > sizeof(contexts[r].buffer))
+                {
+                    throw std::runtime_error("Buffer overrun when writing encoded data!");
+                }
+
+                const auto &ctx = contexts[r], &best_ctx = contexts[best];
+
+                if (ctx.written < best_ctx.written || (ctx.written == best_ctx.written && ctx.error < best_ctx.error))
+                {
+                    best = r;
+                }
             }
 
-            current_offset += frame.base_tree_final_size;
+            const auto &ctx = contexts[best];
+            const dvdb::code_points::reference reference{static_cast<source_e>(best)};
+            const auto reference_ptr = reinterpret_cast<const uint8_t *>(&reference);
+
+            // Reference goes right after setup
+            chunk.data.insert(chunk.data.end(), ctx.buffer, ctx.buffer + sizeof(dvdb::code_points::setup));
+            chunk.data.insert(chunk.data.end(), reference_ptr, reference_ptr + sizeof(reference));
+            chunk.data.insert(chunk.data.end(), ctx.buffer + sizeof(dvdb::code_points::setup), ctx.buffer + ctx.written);
+            chunk.error += ctx.error;
+            previous_rotation = ctx.rotation;
+
+            *final_reader.leaf_table_ptr(i) = finals[best];
+            *final_reader.leaf_bitmask_ptr(i) = final_masks[best];
         }
+    });
+
+    vdb_log_frame_error(dst_reader, final_reader, state);
+
+    return output_data;
+}
+
+// Header of reconstructed state, base trees are followed by their leaves
+dvdb::headers::main diff_frame_header(const utils::nvdb_mmap &nvdb_mmap, dvdb::headers::main::frame_type_e frame_type)
+{
+    dvdb::headers::main header = {
+        .magic = dvdb::MAGIC_NUMBER,
+        .frame_type = frame_type,
+        .flags = dvdb::headers::main::IMPLICIT_SOURCE_KEYS | dvdb::headers::main::DELTA_ROTATIONS | dvdb::headers::main::PREDICTED_MASKS | dvdb::headers::main::BUNDLE_INDEX,
+        .vdb_grid_count = nvdb_mmap.grids().size(),
+        .vdb_required_size = sizeof(header),
+        .frames = {}};
+
+    for (size_t i = 0; i < nvdb_mmap.grids().size(); ++i)
+    {
+        const auto &grid = nvdb_mmap.grids()[i];
+        const auto leafless_size = vdb_determine_leafless_copy_size_direct_ptr(grid.ptr);
+
+        header.frames[i].base_tree_offset_start = header.vdb_required_size;
+        header.frames[i].base_tree_copy_size = leafless_size;
+        header.frames[i].base_tree_final_size = grid.size;
+        header.vdb_required_size += grid.size;
+    }
+
+    return header;
+}
+
+// Header of the file itself, leafless base trees are followed by bundle indices and diff data of all grids
+dvdb::headers::main compressed_diff_header(const dvdb::headers::main &state_header, const utils::nvdb_mmap &nvdb_mmap, const std::vector<std::vector<uint8_t>> &diff_data_chunks, const std::vector<std::vector<uint64_t>> &bundle_indices, size_t *file_size)
+{
+    dvdb::headers::main compressed_header = state_header;
+
+    uint64_t compressed_base_tree_offset = sizeof(compressed_header);
 
-        _state->_vdb_buffer.resize(input.size());
+    for (size_t i = 0; i < nvdb_mmap.grids().size(); ++i)
+    {
+        const auto &grid = nvdb_mmap.grids()[i];
+        const auto leafless_size = vdb_determine_leafless_copy_size_direct_ptr(grid.ptr);
+
+        compressed_header.frames[i].base_tree_offset_start = compressed_base_tree_offset;
+        compressed_header.frames[i].base_tree_copy_size = leafless_size;
+        compressed_header.frames[i].base_tree_final_size = grid.size;
+        // compressed_header.vdb_required_size += grid.size;
+
+        compressed_base_tree_offset += leafless_size;
+    }
+
+    for (const auto &bundle_offsets : bundle_indices)
+    {
+        compressed_base_tree_offset += sizeof(dvdb::headers::bundle_index) + bundle_offsets.size() * sizeof(uint64_t);
+    }
+
+    for (size_t i = 0; i < nvdb_mmap.grids().size(); ++i)
+    {
+        compressed_header.frames[i].diff_data_offset_start = compressed_base_tree_offset;
+        compressed_base_tree_offset += diff_data_chunks[i].size();
+    }
+
+    *file_size = compressed_base_tree_offset;
+
+    return compressed_header;
+}
+} // namespace
+
+namespace converter
+{
+dvdb_converter::dvdb_converter(std::shared_ptr<utils::thread_pool> pool, float max_error)
+    : _thread_pool(std::move(pool)), _state(std::make_unique<dvdb_state>(max_error))
+{
+}
+
+dvdb_converter::~dvdb_converter() = default;
+
+std::string dvdb_converter::current_processing_step()
+{
+    std::lock_guard lock(_state->status_mtx);
+    return _state->status_string;
+}
+
+std::string dvdb_converter::current_compression_step()
+{
+    std::lock_guard lock(_state->status_mtx);
+    return _state->compression_string;
+}
+
+void dvdb_converter::set_output_directory(std::filesystem::path path)
+{
+    _state->output_directory = std::move(path);
+}
+
+void dvdb_converter::set_csv_path(std::filesystem::path path)
+{
+    _state->file = path.empty() ? std::ofstream() : std::ofstream(path);
+}
+
+void dvdb_converter::set_first_frame_number(int number)
+{
+    _state->frame_number = number;
+}
+
+void dvdb_converter::set_keyframe_interval(int frames)
+{
+    _state->keyframe_interval = frames;
+}
+
+void dvdb_converter::set_max_chain_length(int frames)
+{
+    _state->max_chain_length = frames;
+}
+
+void dvdb_converter::set_scene_cut_ratio(float ratio)
+{
+    _state->scene_cut_ratio = ratio;
+}
+
+void dvdb_converter::set_reference_frames(int frames)
+{
+    if (frames < 1 || frames > static_cast<int>(dvdb::MAX_REFERENCE_FRAMES))
+    {
+        throw std::runtime_error("Reference frame count must be between 1 and " + std::to_string(dvdb::MAX_REFERENCE_FRAMES) + ".");
+    }
+
+    _state->reference_frames = frames;
+    _state->reference_history.clear();
+}
+
+void dvdb_converter::set_dct_residuals(bool enabled)
+{
+    _state->dct_residuals = enabled;
+}
+
+void dvdb_converter::set_bidirectional_frames(int frames)
+{
+    _state->bidirectional_frames = frames;
+}
+
+void dvdb_converter::set_target_frame_size(size_t bytes)
+{
+    _state->target_frame_size = bytes;
+}
+
+float dvdb_converter::current_allowed_error()
+{
+    return _state->allowed_error;
+}
 
-        std::memcpy(_state->_vdb_buffer.data(), input.data(), input.size());
+std::filesystem::path dvdb_converter::output_path(const std::filesystem::path &path)
+{
+    auto dvdb_path = path;
+    dvdb_path.replace_extension(".dvdb");
+
+    if (!_state->output_directory.empty())
+    {
+        dvdb_path = _state->output_directory / dvdb_path.filename();
     }
 
+    return dvdb_path;
+}
+
+void dvdb_converter::set_status(std::string str)
+{
+    std::lock_guard lock(_state->status_mtx);
+    _state->status_string = std::move(str);
+}
+
+void dvdb_converter::change_compression_status(int diff)
+{
+    std::lock_guard lock(_state->status_mtx);
+    _state->pending_compressions += diff;
+    _state->compression_string = "Pending files to compress (LZ4): " + std::to_string(_state->pending_compressions);
+}
+
+// Packing runs on the pool, its first failure is kept for flush() or finished() to rethrow
+void dvdb_converter::enqueue_compression(std::function<void()> job)
+{
     change_compression_status(1);
 
-    _thread_pool->enqueue([weak = std::weak_ptr(_state), this, dvdb_path = dvdb_path.string()]() {
+    _thread_pool->enqueue([weak = std::weak_ptr(_state), this, job = std::move(job)]() {
         auto lock = weak.lock();
-        _state->written_size += pack_dvdb_file(dvdb_path.c_str());
-        change_compression_status(-1);
+
+        if (!lock)
+        {
+            return;
+        }
+
+        utils::scope_guard done([this]() { change_compression_status(-1); });
+
+        try
+        {
+            job();
+        }
+        catch (...)
+        {
+            std::lock_guard status_lock(_state->status_mtx);
+
+            if (!_state->compression_error)
+            {
+                _state->compression_error = std::current_exception();
+            }
+        }
     });
+}
+
+void dvdb_converter::rethrow_compression_error()
+{
+    std::exception_ptr error;
+
+    {
+        std::lock_guard lock(_state->status_mtx);
+        error = std::exchange(_state->compression_error, nullptr);
+    }
+
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+void dvdb_converter::prefetch_frame(std::filesystem::path path)
+{
+    std::lock_guard lock(_state->prefetch_mtx);
+
+    if (_state->prefetched_frames.contains(path))
+    {
+        return;
+    }
+
+    auto job = std::make_shared<prefetch_job>(path);
+    _thread_pool->enqueue([job]() { job->run(); });
+    _state->prefetched_frames.emplace(std::move(path), std::move(job));
+}
+
+std::shared_ptr<nvdb_frame> dvdb_converter::acquire_frame(const std::filesystem::path &path)
+{
+    std::shared_ptr<prefetch_job> prefetched;
 
-    if (_state->frame_number == 0)
     {
-        _state->file << "frame;error;min_error;max_error\n";
+        std::lock_guard lock(_state->prefetch_mtx);
+
+        if (auto it = _state->prefetched_frames.find(path); it != _state->prefetched_frames.end())
+        {
+            prefetched = std::move(it->second);
+            _state->prefetched_frames.erase(it);
+        }
+    }
+
+    std::shared_ptr<nvdb_frame> frame;
+
+    if (prefetched)
+    {
+        // Load may still be queued behind packing of earlier frames, run it here instead of waiting for those
+        prefetched->run();
+        frame = prefetched->result.get();
+    }
+    else
+    {
+        frame = std::make_shared<nvdb_frame>(path);
+    }
+
+    _state->read_size += frame->mmap->mem_size();
+
+    return frame;
+}
+
+void dvdb_converter::create_keyframe(std::filesystem::path path)
+{
+    set_status("Loading:\n  " + path.string());
+    create_keyframe(path, acquire_frame(path));
+}
+
+void dvdb_converter::create_keyframe(const std::filesystem::path &path, std::shared_ptr<nvdb_frame> frame)
+{
+    set_status("Rewriting keyframe:\n  " + path.string());
+
+    // Motion vectors refer to leaves of the frame before this one
+    _state->motion_vectors.clear();
+    _state->frames_since_keyframe = 0;
+    _state->last_keyframe_number = _state->frame_number;
+
+    // Nothing before a keyframe may be referenced, GOPs stay independent
+    _state->reference_history.clear();
+
+    const auto &nvdb_mmap = *frame->mmap;
+    const auto dvdb_path = output_path(path);
+
+    {
+        dvdb::headers::main header = {
+            .magic = dvdb::MAGIC_NUMBER,
+            .frame_type = dvdb::headers::main::frame_type_e::KEY_FRAME,
+            .vdb_grid_count = nvdb_mmap.grids().size(),
+            .vdb_required_size = sizeof(header),
+            .frames = {},
+        };
+
+        for (size_t i = 0; i < nvdb_mmap.grids().size(); ++i)
+        {
+            const auto &grid = nvdb_mmap.grids()[i];
+
+            header.frames[i].base_tree_offset_start = header.vdb_required_size;
+            header.frames[i].base_tree_copy_size = grid.size;
+            header.frames[i].base_tree_final_size = grid.size;
+            header.vdb_required_size += grid.size;
+        }
+
+        // Assembled straight into the current state, the file is only written packed
+        auto buffer = std::make_shared<std::vector<uint8_t>>(header.vdb_required_size);
+
+        std::memcpy(buffer->data(), &header, sizeof(header));
+
+        for (size_t i = 0; i < nvdb_mmap.grids().size(); ++i)
+        {
+            const auto &grid = nvdb_mmap.grids()[i];
+
+            std::memcpy(buffer->data() + header.frames[i].base_tree_offset_start, grid.ptr, grid.size);
+        }
+
+        _state->_vdb_buffer = std::move(buffer);
+
+        if (header.vdb_required_size < FORCE_KEYFRAME_SIZE)
+        {
+            _state->previous_was_empty = true;
+        }
     }
 
-    _state->file << _state->frame_number << ';'
-                 << 0 << ';'
-                 << 0 << ';'
-                 << 0 << '\n';
+    // Next anchor replaces the state instead of changing it, packing keeps this one alive
+    enqueue_compression([this, data = _state->_vdb_buffer, dvdb_path = dvdb_path.string()]() {
+        _state->written_size += pack_dvdb_data(reinterpret_cast<const char *>(data->data()), data->size(), dvdb_path.c_str(), _thread_pool.get());
+    });
+
+    vdb_log_row(_state.get(), 0, 0, 0);
 
     ++_state->frame_number;
 }
 
 void dvdb_converter::add_diff_frame(std::filesystem::path path)
 {
-    set_status("Processing interframe:\n  " + path.string());
+    set_status("Loading:\n  " + path.string());
 
-    int alignment_correction = 0;
-    const auto str8 = path.string();
-    const auto nvdb_buffer = converter::unpack_nvdb_file(str8.c_str(), &alignment_correction);
+    auto frame = acquire_frame(path);
 
-    utils::nvdb_mmap nvdb_mmap(nvdb_buffer.data() + alignment_correction);
-    _state->read_size += nvdb_mmap.mem_size();
+    // Without an anchor to predict from there's nothing to wait for
+    if (_state->bidirectional_frames <= 0 || !_state->_vdb_buffer || _state->previous_was_empty)
+    {
+        encode_held_frames();
+        return add_frame(path, std::move(frame));
+    }
 
-    auto dvdb_path = path;
-    dvdb_path.replace_extension(".dvdb");
+    _state->held_frames.emplace_back(path, std::move(frame));
 
-    const auto current_state_header = reinterpret_cast<const dvdb::headers::main *>(_state->_vdb_buffer.data());
+    if (_state->held_frames.size() <= static_cast<size_t>(_state->bidirectional_frames))
+    {
+        set_status("Holding frame for bidirectional prediction:\n  " + path.string());
+        return;
+    }
 
-    // First frame, make keyframe first
-    if (!current_state_header)
+    encode_held_frames();
+}
+
+void dvdb_converter::flush()
+{
+    encode_held_frames();
+    rethrow_compression_error();
+}
+
+void dvdb_converter::encode_held_frames()
+{
+    auto held = std::move(_state->held_frames);
+    _state->held_frames.clear();
+
+    if (held.empty())
     {
-        return create_keyframe(path);
+        return;
     }
 
-    dvdb::headers::main next_state_header = {
-        .magic = dvdb::MAGIC_NUMBER,
-        .frame_type = dvdb::headers::main::frame_type_e::DIFF_FRAME,
-        .vdb_grid_count = current_state_header->vdb_grid_count,
-        .vdb_required_size = sizeof(next_state_header),
-        .frames = {}};
+    const auto &[anchor_path, anchor_frame] = held.back();
+    const auto current_state_header = _state->_vdb_buffer ? reinterpret_cast<const dvdb::headers::main *>(_state->_vdb_buffer->data()) : nullptr;
 
-    for (size_t i = 0; i < nvdb_mmap.grids().size(); ++i)
+    const auto can_predict = [&](const auto &entry) {
+        const auto &grids = entry.second->mmap->grids();
+        const auto required_size = diff_frame_header(*entry.second->mmap, dvdb::headers::main::frame_type_e::BIDIRECTIONAL_FRAME).vdb_required_size;
+
+        return grids.size() == current_state_header->vdb_grid_count && entry.second->readers.size() == grids.size() && required_size >= FORCE_KEYFRAME_SIZE;
+    };
+
+    // Empty or non-f32 frames are handled by the usual keyframe fallbacks, just in display order
+    if (held.size() == 1 || !current_state_header || _state->previous_was_empty || !std::all_of(held.begin(), held.end(), can_predict))
     {
-        const auto &grid = nvdb_mmap.grids()[i];
-        const auto leafless_size = vdb_determine_leafless_copy_size_direct_ptr(grid.ptr);
+        for (auto &[path, frame] : held)
+        {
+            add_frame(path, std::move(frame));
+        }
+
+        return;
+    }
+
+    const int first_frame_number = _state->frame_number;
+    const auto previous_anchor = _state->_vdb_buffer;
+
+    _state->hold_csv_rows = true;
+
+    utils::scope_guard write_rows([this]() {
+        for (const auto &[frame_number, rows] : _state->held_csv_rows)
+        {
+            _state->file << rows;
+        }
+
+        _state->held_csv_rows.clear();
+        _state->hold_csv_rows = false;
+    });
+
+    // Anchor is written first, decoder needs it before any frame in between
+    _state->frame_number = first_frame_number + static_cast<int>(held.size()) - 1;
+    add_frame(anchor_path, anchor_frame);
+
+    for (size_t i = 0; i + 1 < held.size(); ++i)
+    {
+        _state->frame_number = first_frame_number + static_cast<int>(i);
+        create_bidirectional_frame(held[i].first, std::move(held[i].second), *previous_anchor);
+    }
+
+    _state->frame_number = first_frame_number + static_cast<int>(held.size());
+}
+
+void dvdb_converter::add_frame(const std::filesystem::path &path, std::shared_ptr<nvdb_frame> frame)
+{
+    set_status("Processing interframe:\n  " + path.string());
+
+    const auto &nvdb_mmap = *frame->mmap;
+    const auto dvdb_path = output_path(path);
 
-        next_state_header.frames[i].base_tree_offset_start = next_state_header.vdb_required_size;
-        next_state_header.frames[i].base_tree_copy_size = leafless_size;
-        next_state_header.frames[i].base_tree_final_size = grid.size;
-        next_state_header.vdb_required_size += grid.size;
+    const auto current_state_header = _state->_vdb_buffer ? reinterpret_cast<const dvdb::headers::main *>(_state->_vdb_buffer->data()) : nullptr;
+
+    // First frame, make keyframe first
+    if (!current_state_header)
+    {
+        return create_keyframe(path, std::move(frame));
     }
 
+    auto next_state_header = diff_frame_header(nvdb_mmap, dvdb::headers::main::frame_type_e::DIFF_FRAME);
+
     // look this tree is probably leafless and has no values. Diff breaks on this so just do it the normal way...
     if (bool is_empty = next_state_header.vdb_required_size < FORCE_KEYFRAME_SIZE; is_empty || _state->previous_was_empty)
     {
         _state->previous_was_empty = is_empty;
-        return create_keyframe(path);
+        return create_keyframe(path, std::move(frame));
     }
     else
     {
         _state->previous_was_empty = false;
     }
 
+    // Anchors can skip over the multiple when bidirectional frames are held, first one past it is promoted then
+    const int interval = _state->keyframe_interval;
+    const bool interval_reached = interval > 0 && (_state->last_keyframe_number < 0 || _state->frame_number / interval > _state->last_keyframe_number / interval);
+    const bool chain_too_long = _state->max_chain_length > 0 && _state->frames_since_keyframe >= _state->max_chain_length;
+
+    if (interval_reached || chain_too_long)
+    {
+        return create_keyframe(path, std::move(frame));
+    }
+
+    if (frame->readers.size() != nvdb_mmap.grids().size())
+    {
+        frame->build_readers();
+    }
+
+    if (!_state->reference_history.empty())
+    {
+        next_state_header.frame_type = dvdb::headers::main::frame_type_e::MULTI_REFERENCE_FRAME;
+    }
+
     std::vector<uint8_t> next_buffer(next_state_header.vdb_required_size);
     std::memcpy(next_buffer.data(), &next_state_header, sizeof(next_state_header));
 
     std::vector<std::vector<uint8_t>> diff_data_chunks;
+    std::vector<std::vector<uint64_t>> bundle_indices(nvdb_mmap.grids().size());
+    _state->motion_vectors.resize(nvdb_mmap.grids().size());
+
+    // Scene cut, diff costs nearly as much as whole frame and would only drag its error along the chain
+    const auto is_scene_cut = [&](size_t size) { return _state->scene_cut_ratio > 0 && size > _state->scene_cut_ratio * next_state_header.vdb_required_size; };
+    size_t diff_size = 0;
 
     for (size_t i = 0; i < nvdb_mmap.grids().size(); ++i)
     {
@@ -658,73 +1582,149 @@ void dvdb_converter::add_diff_frame(std::filesystem::path path)
 
         std::memcpy(dst, grid.ptr, size);
 
-        const auto source_state_ptr = _state->_vdb_buffer.data() + current_state_header->frames[i].base_tree_offset_start;
-        const auto destination_state_ptr = grid.ptr;
+        const auto source_state_ptr = _state->_vdb_buffer->data() + current_state_header->frames[i].base_tree_offset_start;
         const auto diff_state_ptr = next_buffer.data() + next_state_header.frames[i].base_tree_offset_start;
 
+        std::vector<const void *> older_state_ptrs;
+
+        for (const auto &older_state : _state->reference_history)
+        {
+            const auto older_header = reinterpret_cast<const dvdb::headers::main *>(older_state->data());
+            older_state_ptrs.push_back(older_state->data() + older_header->frames[i].base_tree_offset_start);
+        }
+
         set_status("Creating diff (grid " + std::to_string(i) + ")\n  " + dvdb_path.string());
 
-        diff_data_chunks.emplace_back(vdb_create_rle_diff(source_state_ptr, destination_state_ptr, diff_state_ptr, _state.get(), _thread_pool));
+        diff_data_chunks.emplace_back(vdb_create_rle_diff(source_state_ptr, older_state_ptrs, frame->readers[i], diff_state_ptr, &_state->motion_vectors[i], &bundle_indices[i], _state.get(), _thread_pool));
+
+        // Remaining grids can only add to it
+        if (diff_size += diff_data_chunks.back().size(); is_scene_cut(diff_size))
+        {
+            return create_keyframe(path, std::move(frame));
+        }
     }
 
     set_status("Realigning data\n  " + dvdb_path.string());
 
-    dvdb::headers::main compressed_header = next_state_header;
+    size_t file_size = 0;
+    const auto compressed_header = compressed_diff_header(next_state_header, nvdb_mmap, diff_data_chunks, bundle_indices, &file_size);
 
-    uint64_t compressed_base_tree_offset = sizeof(compressed_header);
+    if (is_scene_cut(file_size))
+    {
+        return create_keyframe(path, std::move(frame));
+    }
 
     for (size_t i = 0; i < nvdb_mmap.grids().size(); ++i)
     {
-        const auto &grid = nvdb_mmap.grids()[i];
-        const auto leafless_size = vdb_determine_leafless_copy_size_direct_ptr(grid.ptr);
+        nvdb_reader final_reader{};
+        final_reader.initialize(next_buffer.data() + next_state_header.frames[i].base_tree_offset_start);
 
-        compressed_header.frames[i].base_tree_offset_start = compressed_base_tree_offset;
-        compressed_header.frames[i].base_tree_copy_size = leafless_size;
-        compressed_header.frames[i].base_tree_final_size = grid.size;
-        // compressed_header.vdb_required_size += grid.size;
+        vdb_log_frame_error(frame->readers[i], final_reader, _state.get());
+    }
 
-        compressed_base_tree_offset += leafless_size;
+    if (_state->reference_frames > 1)
+    {
+        _state->reference_history.insert(_state->reference_history.begin(), std::move(_state->_vdb_buffer));
+        _state->reference_history.resize(std::min<size_t>(_state->reference_history.size(), _state->reference_frames - 1));
     }
 
+    _state->_vdb_buffer = std::make_shared<const std::vector<uint8_t>>(std::move(next_buffer));
+    ++_state->frames_since_keyframe;
+
+    rate_control_update(_state.get(), file_size);
+
+    write_diff_frame(dvdb_path, std::move(frame), compressed_header, std::move(diff_data_chunks), std::move(bundle_indices), file_size);
+
+    ++_state->frame_number;
+}
+
+void dvdb_converter::create_bidirectional_frame(const std::filesystem::path &path, std::shared_ptr<nvdb_frame> frame, const std::vector<uint8_t> &previous_anchor)
+{
+    set_status("Processing bidirectional frame:\n  " + path.string());
+
+    const auto &nvdb_mmap = *frame->mmap;
+    const auto dvdb_path = output_path(path);
+
+    const auto previous_header = reinterpret_cast<const dvdb::headers::main *>(previous_anchor.data());
+    const auto next_header = reinterpret_cast<const dvdb::headers::main *>(_state->_vdb_buffer->data());
+
+    const auto frame_header = diff_frame_header(nvdb_mmap, dvdb::headers::main::frame_type_e::BIDIRECTIONAL_FRAME);
+
+    // Only kept for error statistics, nothing is ever predicted from this frame
+    std::vector<uint8_t> final_buffer(frame_header.vdb_required_size);
+    std::memcpy(final_buffer.data(), &frame_header, sizeof(frame_header));
+
+    std::vector<std::vector<uint8_t>> diff_data_chunks;
+    std::vector<std::vector<uint64_t>> bundle_indices(nvdb_mmap.grids().size());
+
     for (size_t i = 0; i < nvdb_mmap.grids().size(); ++i)
     {
-        compressed_header.frames[i].diff_data_offset_start = compressed_base_tree_offset;
-        compressed_base_tree_offset += diff_data_chunks[i].size();
+        const auto &grid = nvdb_mmap.grids()[i];
+        const auto final_ptr = final_buffer.data() + frame_header.frames[i].base_tree_offset_start;
+
+        std::memcpy(final_ptr, grid.ptr, frame_header.frames[i].base_tree_copy_size);
+
+        const auto previous_ptr = previous_anchor.data() + previous_header->frames[i].base_tree_offset_start;
+        const auto next_ptr = _state->_vdb_buffer->data() + next_header->frames[i].base_tree_offset_start;
+
+        set_status("Creating bidirectional diff (grid " + std::to_string(i) + ")\n  " + dvdb_path.string());
+
+        diff_data_chunks.emplace_back(vdb_create_bidirectional_diff(previous_ptr, next_ptr, frame->readers[i], final_ptr, &bundle_indices[i], _state.get(), _thread_pool));
     }
 
-    {
-        std::ofstream output(dvdb_path.string(), std::ios::binary);
+    size_t file_size = 0;
+    const auto compressed_header = compressed_diff_header(frame_header, nvdb_mmap, diff_data_chunks, bundle_indices, &file_size);
 
-        output.write(reinterpret_cast<const char *>(&compressed_header), sizeof(compressed_header));
+    write_diff_frame(dvdb_path, std::move(frame), compressed_header, std::move(diff_data_chunks), std::move(bundle_indices), file_size);
 
-        set_status("Writing grids\n  " + dvdb_path.string());
+    ++_state->frame_number;
+}
 
-        for (size_t i = 0; i < nvdb_mmap.grids().size(); ++i)
+void dvdb_converter::write_diff_frame(const std::filesystem::path &dvdb_path, std::shared_ptr<nvdb_frame> frame, const dvdb::headers::main &compressed_header, std::vector<std::vector<uint8_t>> diff_data_chunks, std::vector<std::vector<uint64_t>> bundle_indices, size_t file_size)
+{
+    // Writing and packing only needs this frame's data, next frame can be encoded in the meantime
+    enqueue_compression([this, frame = std::move(frame), compressed_header, diff_data_chunks = std::move(diff_data_chunks), bundle_indices = std::move(bundle_indices), dvdb_path = dvdb_path.string(), file_size]() {
+        std::vector<char> data(file_size);
+        char *output = data.data();
+
+        const auto append = [&](const void *src, size_t size) {
+            std::memcpy(output, src, size);
+            output += size;
+        };
+
+        append(&compressed_header, sizeof(compressed_header));
+
+        for (size_t i = 0; i < frame->mmap->grids().size(); ++i)
         {
-            const auto &grid = nvdb_mmap.grids()[i];
+            const auto &grid = frame->mmap->grids()[i];
 
-            output.write(reinterpret_cast<const char *>(grid.ptr), compressed_header.frames[i].base_tree_copy_size);
+            append(grid.ptr, compressed_header.frames[i].base_tree_copy_size);
         }
 
-        set_status("Writing diffs\n  " + dvdb_path.string());
+        for (const auto &bundle_offsets : bundle_indices)
+        {
+            const dvdb::headers::bundle_index index{.bundle_count = bundle_offsets.size()};
+
+            append(&index, sizeof(index));
+            append(bundle_offsets.data(), bundle_offsets.size() * sizeof(uint64_t));
+        }
 
         for (size_t i = 0; i < diff_data_chunks.size(); ++i)
         {
-            output.write(reinterpret_cast<const char *>(diff_data_chunks[i].data()), diff_data_chunks[i].size());
+            append(diff_data_chunks[i].data(), diff_data_chunks[i].size());
         }
-    }
 
-    _state->_vdb_buffer = std::move(next_buffer);
+        if (output != data.data() + data.size())
+        {
+            throw std::runtime_error("Diff frame size mismatch!");
+        }
 
-    change_compression_status(1);
+        const auto packed_size = pack_dvdb_data(data.data(), data.size(), dvdb_path.c_str(), _thread_pool.get());
 
-    _thread_pool->enqueue([weak = std::weak_ptr(_state), this, dvdb_path = dvdb_path.string()]() {
-        auto lock = weak.lock();
-        _state->written_size += pack_dvdb_file(dvdb_path.c_str());
-        change_compression_status(-1);
+        _state->written_size += packed_size;
+        _state->diff_packed_input_size += file_size;
+        _state->diff_packed_output_size += packed_size;
     });
-
-    ++_state->frame_number;
 }
 
 float dvdb_converter::current_compression_ratio()
@@ -737,6 +1737,16 @@ float dvdb_converter::current_compression_ratio()
     return static_cast<float>(_state->read_size) / _state->written_size;
 }
 
+size_t dvdb_converter::current_read_size()
+{
+    return _state->read_size;
+}
+
+size_t dvdb_converter::current_written_size()
+{
+    return _state->written_size;
+}
+
 size_t dvdb_converter::current_total_leaves()
 {
     return _state->leaves_total;
@@ -749,6 +1759,7 @@ size_t dvdb_converter::current_processed_leaves()
 
 bool dvdb_converter::finished()
 {
+    rethrow_compression_error();
     return _state->pending_compressions == 0;
 }
 } // namespace converter
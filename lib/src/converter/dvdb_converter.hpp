@@ -2,6 +2,7 @@
 
 #include "common.hpp"
 
+#include <functional>
 #include <memory>
 
 namespace utils
@@ -9,9 +10,15 @@ namespace utils
 class thread_pool;
 }
 
+namespace dvdb::headers
+{
+struct main;
+}
+
 namespace converter
 {
 struct dvdb_state;
+struct nvdb_frame;
 
 class dvdb_converter
 {
@@ -19,22 +26,51 @@ public:
     dvdb_converter(std::shared_ptr<utils::thread_pool> = {}, float max_error = 0);
     ~dvdb_converter();
 
+    void set_output_directory(std::filesystem::path); // empty means next to the source file
+    void set_target_frame_size(size_t bytes);         // 0 keeps max_error fixed, otherwise it's adjusted after every diff frame
+    void set_csv_path(std::filesystem::path);          // per frame error log, empty disables it
+    void set_first_frame_number(int);                  // for sequences split between converters, used by log and keyframe interval
+
+    // GOP policy, 0 disables each of them. Empty frames always force keyframes.
+    void set_keyframe_interval(int frames); // keyframe on every n-th frame, or the first anchor after it
+    void set_max_chain_length(int frames);  // diff frames allowed after a keyframe
+    void set_scene_cut_ratio(float ratio);  // keyframe when uncompressed diff exceeds this fraction of full frame size
+
+    void set_bidirectional_frames(int frames); // frames between anchors predicted from both of them, 0 disables it
+    void set_reference_frames(int frames);     // past anchors a leaf may be predicted from, 1 is just the previous one
+    void set_dct_residuals(bool enabled);      // also try coding residuals as DCT weights, slower but smaller on smooth data
+
+    void prefetch_frame(std::filesystem::path); // Loads frame in the background ahead of create_keyframe/add_diff_frame
+
     void create_keyframe(std::filesystem::path);
     void add_diff_frame(std::filesystem::path); // Now automatically falls back to keyframes if appropriate
+    void flush();                               // Encodes frames held for bidirectional prediction, call after the last one
     conversion_result process_next();
 
     float current_compression_ratio();
+    float current_allowed_error();
+    size_t current_read_size();
+    size_t current_written_size();
     std::string current_processing_step();
     std::string current_compression_step();
 
     size_t current_total_leaves();
     size_t current_processed_leaves();
 
-    bool finished();
+    bool finished(); // Rethrows the first error of packing frames in the background
 
 private:
+    std::shared_ptr<nvdb_frame> acquire_frame(const std::filesystem::path &);
+    void create_keyframe(const std::filesystem::path &, std::shared_ptr<nvdb_frame>);
+    void add_frame(const std::filesystem::path &, std::shared_ptr<nvdb_frame>);
+    void create_bidirectional_frame(const std::filesystem::path &, std::shared_ptr<nvdb_frame>, const std::vector<uint8_t> &previous_anchor);
+    void encode_held_frames();
+    void write_diff_frame(const std::filesystem::path &dvdb_path, std::shared_ptr<nvdb_frame>, const dvdb::headers::main &, std::vector<std::vector<uint8_t>> diff_data_chunks, std::vector<std::vector<uint64_t>> bundle_indices, size_t file_size);
+    std::filesystem::path output_path(const std::filesystem::path &);
     void set_status(std::string);
     void change_compression_status(int diff);
+    void enqueue_compression(std::function<void()> job);
+    void rethrow_compression_error();
 
     std::shared_ptr<utils::thread_pool> _thread_pool;
     std::shared_ptr<dvdb_state> _state;
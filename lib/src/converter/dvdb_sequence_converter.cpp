@@ -0,0 +1,160 @@
+#include "dvdb_sequence_converter.hpp"
+#include "dvdb_converter.hpp"
+
+#include <utils/thread_pool.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <fstream>
+#include <future>
+#include <iostream>
+
+namespace converter
+{
+namespace
+{
+std::filesystem::path gop_csv_path(const dvdb_sequence_settings &settings, size_t gop)
+{
+    return settings.output_directory / ("dvdb_cvt_" + std::to_string(gop) + ".csv");
+}
+
+// Only the first GOP writes csv header, so logs can be joined in order
+void stitch_csv_logs(const dvdb_sequence_settings &settings, size_t gop_count)
+{
+    std::ofstream output(settings.output_directory / "dvdb_cvt.csv");
+
+    for (size_t gop = 0; gop < gop_count; ++gop)
+    {
+        const auto path = gop_csv_path(settings, gop);
+
+        {
+            std::ifstream input(path);
+            output << input.rdbuf();
+        }
+
+        std::filesystem::remove(path);
+    }
+}
+} // namespace
+
+dvdb_sequence_result convert_sequence_to_dvdb(const std::vector<std::filesystem::path> &files, std::shared_ptr<utils::thread_pool> thread_pool, const dvdb_sequence_settings &settings)
+{
+    if (settings.gop_length <= 0)
+    {
+        throw std::runtime_error("GOP length must be positive.");
+    }
+
+    const size_t gop_length = settings.gop_length;
+    const size_t gop_count = (files.size() + gop_length - 1) / gop_length;
+    const size_t driver_count = std::min<size_t>(settings.parallel_gops > 0 ? settings.parallel_gops : thread_pool->worker_count(), gop_count);
+
+    // Pending packs of a converter keep referring to it, so all of them live until the pool is drained
+    std::vector<std::unique_ptr<dvdb_converter>> converters(gop_count);
+    std::atomic<size_t> next_gop = 0;
+
+    const auto drive = [&]() {
+        for (size_t gop = next_gop++; gop < gop_count; gop = next_gop++)
+        {
+            const size_t begin = gop * gop_length;
+            const size_t end = std::min(begin + gop_length, files.size());
+
+            auto &converter = converters[gop];
+
+            converter = std::make_unique<dvdb_converter>(thread_pool, settings.max_error);
+            converter->set_output_directory(settings.output_directory);
+            converter->set_csv_path(gop_csv_path(settings, gop));
+            converter->set_first_frame_number(begin);
+            converter->set_target_frame_size(settings.target_frame_size);
+            converter->set_max_chain_length(settings.max_chain_length);
+            converter->set_scene_cut_ratio(settings.scene_cut_ratio);
+            converter->set_bidirectional_frames(settings.bidirectional_frames);
+            converter->set_reference_frames(settings.reference_frames);
+            converter->set_dct_residuals(settings.dct_residuals);
+
+            for (size_t i = begin; i < end; ++i)
+            {
+                if (i + 1 < end)
+                {
+                    converter->prefetch_frame(files[i + 1]);
+                }
+
+                converter->add_diff_frame(files[i]);
+            }
+
+            converter->flush();
+
+            std::cout << "[dvdb_sequence_converter] finished GOP " << gop + 1 << '/' << gop_count << '\n';
+        }
+    };
+
+    // Drivers only walk frames in order, leaf encoding of all GOPs is spread over the shared pool
+    std::vector<std::future<void>> drivers;
+
+    for (size_t i = 0; i < driver_count; ++i)
+    {
+        drivers.emplace_back(std::async(std::launch::async, drive));
+    }
+
+    for (auto &driver : drivers)
+    {
+        driver.wait();
+    }
+
+    thread_pool->finish();
+
+    // Packs of the last frames outlive flush, their errors only surface once the pool is drained
+    std::exception_ptr error;
+
+    const auto keep_first_error = [&](auto &&check) {
+        try
+        {
+            check();
+        }
+        catch (...)
+        {
+            if (!error)
+            {
+                error = std::current_exception();
+            }
+        }
+    };
+
+    for (auto &driver : drivers)
+    {
+        keep_first_error([&] { driver.get(); });
+    }
+
+    for (auto &converter : converters)
+    {
+        if (converter)
+        {
+            keep_first_error([&] { converter->finished(); });
+        }
+    }
+
+    dvdb_sequence_result result;
+
+    for (auto &converter : converters)
+    {
+        if (converter)
+        {
+            result.read_size += converter->current_read_size();
+            result.written_size += converter->current_written_size();
+        }
+    }
+
+    // Closes csv logs
+    converters.clear();
+
+    // Per GOP logs of a failed conversion are kept as they are
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+
+    stitch_csv_logs(settings, gop_count);
+
+    return result;
+}
+} // namespace converter
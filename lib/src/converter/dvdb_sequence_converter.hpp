@@ -0,0 +1,43 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <memory>
+
+namespace utils
+{
+class thread_pool;
+}
+
+namespace converter
+{
+struct dvdb_sequence_settings
+{
+    float max_error = 0;
+    int gop_length = 30;   // frames per independently encoded group, each one starts with a keyframe
+    int parallel_gops = 0; // groups encoded at once, 0 means as many as thread pool workers
+
+    size_t target_frame_size = 0;
+    int max_chain_length = 0;
+    float scene_cut_ratio = 0;
+    int bidirectional_frames = 0; // never reach across GOPs, last frame of each is an anchor
+    int reference_frames = 1;
+    bool dct_residuals = true;
+
+    std::filesystem::path output_directory; // empty means next to the source files
+};
+
+struct dvdb_sequence_result
+{
+    size_t read_size = 0;
+    size_t written_size = 0;
+
+    float compression_ratio() const
+    {
+        return written_size == 0 ? 0 : static_cast<float>(read_size) / written_size;
+    }
+};
+
+// Files must be sorted by frame number. Each GOP gets its own dvdb_converter, all of them share one thread pool.
+dvdb_sequence_result convert_sequence_to_dvdb(const std::vector<std::filesystem::path> &files, std::shared_ptr<utils::thread_pool>, const dvdb_sequence_settings &);
+} // namespace converter
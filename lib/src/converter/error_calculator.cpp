@@ -4,7 +4,7 @@
 
 namespace converter
 {
-error_result calculate_error(nvdb_reader lhs, nvdb_reader rhs)
+error_result calculate_error(const nvdb_reader &lhs, const nvdb_reader &rhs)
 {
     const auto count = lhs.leaf_count();
 
@@ -11,5 +11,5 @@ namespace converter
         double max_error;
     };
 
-    error_result calculate_error(nvdb_reader lhs, nvdb_reader rhs);
+    error_result calculate_error(const nvdb_reader &lhs, const nvdb_reader &rhs);
 }
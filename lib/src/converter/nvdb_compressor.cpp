@@ -68,8 +68,18 @@ glm::uvec4 unpack_nvdb_file(const char *filename, void *dest, size_t size, size_
 {
     mio::mmap_source mmap(filename);
 
-    const auto *header = reinterpret_cast<const dvdb::headers::nvdb_block_description *>(mmap.data());
-    const char *data_begin = mmap.data() + sizeof(*header);
+    return unpack_nvdb_data(mmap.data(), mmap.size(), dest, size, copied);
+}
+
+glm::uvec4 unpack_nvdb_data(const char *data, size_t data_size, void *dest, size_t size, size_t *copied)
+{
+    const auto *header = reinterpret_cast<const dvdb::headers::nvdb_block_description *>(data);
+    const char *data_begin = data + sizeof(*header);
+
+    if (data_size < sizeof(*header) || header->compressed_size > data_size - sizeof(*header))
+    {
+        throw std::runtime_error("Packed frame is truncated!");
+    }
 
     int decompressed = dvdb::decompress_stream(data_begin, header->compressed_size, reinterpret_cast<char *>(dest), size);
 
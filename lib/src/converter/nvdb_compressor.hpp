@@ -8,5 +8,6 @@ namespace converter
 {
 int pack_nvdb_file(const char *filename);
 glm::uvec4 unpack_nvdb_file(const char *filename, void *dest, size_t size, size_t *copied);
+glm::uvec4 unpack_nvdb_data(const char *data, size_t data_size, void *dest, size_t size, size_t *copied);
 std::vector<char> unpack_nvdb_file(const char *filename, int *alignment_correction);
 } // namespace converter
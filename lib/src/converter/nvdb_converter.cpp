@@ -17,7 +17,7 @@
 
 namespace converter
 {
-conversion_result convert_to_nvdb(std::filesystem::path path, nvdb_format format, float error, nvdb_error_method error_method)
+conversion_result convert_to_nvdb(std::filesystem::path path, nvdb_format format, float error, nvdb_error_method error_method, std::filesystem::path output_directory)
 {
     conversion_result res;
 
@@ -39,6 +39,11 @@ conversion_result convert_to_nvdb(std::filesystem::path path, nvdb_format format
     auto nvdb_path = path;
     nvdb_path.replace_extension(".nvdb");
 
+    if (!output_directory.empty())
+    {
+        nvdb_path = output_directory / nvdb_path.filename();
+    }
+
     std::vector<nanovdb::GridHandle<nanovdb::HostBuffer>> original_grids;
 
     {
@@ -134,7 +139,7 @@ conversion_result convert_to_nvdb(std::filesystem::path path, nvdb_format format
     new_rdr.initialize(const_cast<void *>(header_reader.grids().front().ptr));
     org_rdr.initialize(original_grids.front().data());
 
-    const auto error_result = calculate_error(std::move(org_rdr), std::move(new_rdr));
+    const auto error_result = calculate_error(org_rdr, new_rdr);
 
     std::cout << "[nvdb_converter] finished frame: " << path << '\n';
 
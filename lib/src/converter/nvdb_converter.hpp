@@ -22,7 +22,7 @@ enum class nvdb_error_method
     relative,
 };
 
-conversion_result convert_to_nvdb(std::filesystem::path, nvdb_format, float error = 0.01, nvdb_error_method = nvdb_error_method::relative);
+conversion_result convert_to_nvdb(std::filesystem::path, nvdb_format, float error = 0.01, nvdb_error_method = nvdb_error_method::relative, std::filesystem::path output_directory = {});
 
 std::vector<char> nvdb_to_nvdb_float(const char* handle);
 std::vector<char> nvdb_to_nvdb_float(const std::vector<char>& in);
@@ -45,6 +45,21 @@ void mul(const cube_888_f32 *lhs, const cube_888_f32 *rhs, cube_888_f32 *dst)
     }
 }
 
+void average(const cube_888_f32 *lhs, const cube_888_f32 *rhs, cube_888_f32 *dst)
+{
+    __m256 ymm_half = _mm256_set1_ps(0.5f);
+
+    for (int i = 0; i < std::size(lhs->values); i += 8)
+    {
+        __m256 ymm_a = _mm256_loadu_ps(lhs->values + i);
+        __m256 ymm_b = _mm256_loadu_ps(rhs->values + i);
+
+        __m256 ymm_dst = _mm256_mul_ps(_mm256_add_ps(ymm_a, ymm_b), ymm_half);
+
+        _mm256_storeu_ps(dst->values + i, ymm_dst);
+    }
+}
+
 void fma(const cube_888_f32 *src, cube_888_f32 *dst, float add, float mul)
 {
     __m256 ymm_add = _mm256_set1_ps(add);
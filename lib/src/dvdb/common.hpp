@@ -7,6 +7,7 @@ namespace dvdb
 void add(const cube_888_f32 *lhs, const cube_888_f32 *rhs, cube_888_f32 *dst);
 void sub(const cube_888_f32 *lhs, const cube_888_f32 *rhs, cube_888_f32 *dst);
 void mul(const cube_888_f32 *lhs, const cube_888_f32 *rhs, cube_888_f32 *dst);
+void average(const cube_888_f32 *lhs, const cube_888_f32 *rhs, cube_888_f32 *dst);
 void fma(const cube_888_f32 *src, cube_888_f32 *dst, float add, float mul);
 
 void div(const cube_888_f32 *lhs, const cube_888_f32 *rhs, cube_888_f32 *dst);
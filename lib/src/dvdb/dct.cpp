@@ -9,6 +9,7 @@
 #include <cstring>
 #include <iterator>
 #include <numbers>
+#include <numeric>
 
 namespace dvdb
 {
@@ -61,7 +62,7 @@ void dct_accumulate_decode_cell(float wgt, const cube_888_f32 *dct, cube_888_f32
     }
 }
 
-void dct_3d_encode(const cube_888_f32 *src, cube_888_f32 *dst)
+void dct_3d_encode_tables(const cube_888_f32 *src, cube_888_f32 *dst)
 {
     for (int i = 0; i < std::size(dct_3d_f32.tables); ++i)
     {
@@ -77,7 +78,7 @@ void dct_1d_encode(const cube_888_f32 *src, cube_888_f32 *dst)
     }
 }
 
-void dct_3d_decode(const cube_888_f32 *dct, cube_888_f32 *out)
+void dct_3d_decode_tables(const cube_888_f32 *dct, cube_888_f32 *out)
 {
     *out = {};
 
@@ -94,6 +95,145 @@ void dct_3d_decode(const cube_888_f32 *dct, cube_888_f32 *out)
     }
 }
 
+namespace
+{
+// 8 point DCT-II basis scaled like the 3D tables, [frequency][coordinate]
+alignas(__m256) float dct_8_basis[8][8];
+// Its transposition, DCT-III
+alignas(__m256) float dct_8_basis_inverse[8][8];
+
+static constexpr int SPARSE_DECODE_LIMIT = 48; // Below this many weights accumulating tables is cheaper than three passes
+
+void transpose_8x8(__m256 *rows)
+{
+    const __m256 t0 = _mm256_unpacklo_ps(rows[0], rows[1]);
+    const __m256 t1 = _mm256_unpackhi_ps(rows[0], rows[1]);
+    const __m256 t2 = _mm256_unpacklo_ps(rows[2], rows[3]);
+    const __m256 t3 = _mm256_unpackhi_ps(rows[2], rows[3]);
+    const __m256 t4 = _mm256_unpacklo_ps(rows[4], rows[5]);
+    const __m256 t5 = _mm256_unpackhi_ps(rows[4], rows[5]);
+    const __m256 t6 = _mm256_unpacklo_ps(rows[6], rows[7]);
+    const __m256 t7 = _mm256_unpackhi_ps(rows[6], rows[7]);
+
+    const __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+    const __m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+    const __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    const __m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+    const __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+    const __m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+    const __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+    const __m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+
+    rows[0] = _mm256_permute2f128_ps(s0, s4, 0x20);
+    rows[1] = _mm256_permute2f128_ps(s1, s5, 0x20);
+    rows[2] = _mm256_permute2f128_ps(s2, s6, 0x20);
+    rows[3] = _mm256_permute2f128_ps(s3, s7, 0x20);
+    rows[4] = _mm256_permute2f128_ps(s0, s4, 0x31);
+    rows[5] = _mm256_permute2f128_ps(s1, s5, 0x31);
+    rows[6] = _mm256_permute2f128_ps(s2, s6, 0x31);
+    rows[7] = _mm256_permute2f128_ps(s3, s7, 0x31);
+}
+
+// 8 point transform across rows, 8 transforms at once (one per lane)
+void transform_8_rows(__m256 *rows, int stride, const float (*matrix)[8])
+{
+    __m256 in[8];
+
+    for (int c = 0; c < 8; ++c)
+    {
+        in[c] = rows[c * stride];
+    }
+
+    for (int k = 0; k < 8; ++k)
+    {
+        __m256 ymm_acc = _mm256_mul_ps(_mm256_set1_ps(matrix[k][0]), in[0]);
+
+        for (int c = 1; c < 8; ++c)
+        {
+            ymm_acc = _mm256_fmadd_ps(_mm256_set1_ps(matrix[k][c]), in[c], ymm_acc);
+        }
+
+        rows[k * stride] = ymm_acc;
+    }
+}
+
+// Rows are x lines indexed by y + 8 * z
+void transform_3d(__m256 *rows, const float (*matrix)[8])
+{
+    for (int z = 0; z < 8; ++z)
+    {
+        const auto slice = rows + z * 8;
+
+        transform_8_rows(slice, 1, matrix); // along y
+        transpose_8x8(slice);
+        transform_8_rows(slice, 1, matrix); // along x
+        transpose_8x8(slice);
+    }
+
+    for (int y = 0; y < 8; ++y)
+    {
+        transform_8_rows(rows + y, 8, matrix); // along z
+    }
+}
+} // namespace
+
+void dct_3d_encode(const cube_888_f32 *src, cube_888_f32 *dst)
+{
+    __m256 rows[64];
+
+    for (int i = 0; i < 64; ++i)
+    {
+        rows[i] = _mm256_loadu_ps(src->values + i * 8);
+    }
+
+    transform_3d(rows, dct_8_basis);
+
+    alignas(__m256) float weights[512];
+
+    for (int i = 0; i < 64; ++i)
+    {
+        _mm256_store_ps(weights + i * 8, rows[i]);
+    }
+
+    static constexpr float reciprocal = 1.f / 512.f;
+
+    for (int i = 0; i < std::size(dst->values); ++i)
+    {
+        dst->values[i] = weights[hilbert_curve_indices.values[i]] * reciprocal;
+    }
+}
+
+void dct_3d_decode(const cube_888_f32 *dct, cube_888_f32 *out)
+{
+    alignas(__m256) float weights[512];
+    int non_zero = 0;
+
+    for (int i = 0; i < std::size(dct->values); ++i)
+    {
+        weights[hilbert_curve_indices.values[i]] = dct->values[i];
+        non_zero += dct->values[i] != 0.f;
+    }
+
+    if (non_zero < SPARSE_DECODE_LIMIT)
+    {
+        return dct_3d_decode_tables(dct, out);
+    }
+
+    __m256 rows[64];
+
+    for (int i = 0; i < 64; ++i)
+    {
+        rows[i] = _mm256_load_ps(weights + i * 8);
+    }
+
+    transform_3d(rows, dct_8_basis_inverse);
+
+    for (int i = 0; i < 64; ++i)
+    {
+        _mm256_storeu_ps(out->values + i * 8, rows[i]);
+    }
+}
+
 void dct_1d_decode(const cube_888_f32 *dct, cube_888_f32 *out)
 {
     *out = {};
@@ -186,6 +326,47 @@ void dct_3d_optimize(cube_888_f32 *dct, float max_mse, int max_tables)
     dct_optimize(dct, max_mse, max_tables, dct_3d_decode);
 }
 
+int dct_3d_truncate(cube_888_f32 *dct, float max_mse)
+{
+    uint16_t order[512];
+
+    std::iota(std::begin(order), std::end(order), 0);
+    std::sort(std::begin(order), std::end(order), [&](uint16_t lhs, uint16_t rhs) {
+        return std::abs(dct->values[lhs]) < std::abs(dct->values[rhs]);
+    });
+
+    float dropped_energy = 0;
+    int dropped = 0;
+
+    for (; dropped < std::size(order); ++dropped)
+    {
+        const float weight = dct->values[order[dropped]];
+
+        if (dropped_energy + weight * weight > max_mse)
+        {
+            break;
+        }
+
+        dropped_energy += weight * weight;
+        dct->values[order[dropped]] = 0.f;
+    }
+
+    return static_cast<int>(std::size(order)) - dropped;
+}
+
+void dct_snap_to_zero(cube_888_f32 *dct, float step)
+{
+    const float limit = step * 0.5f;
+
+    for (int i = 0; i < std::size(dct->values); ++i)
+    {
+        if (std::abs(dct->values[i]) < limit)
+        {
+            dct->values[i] = 0.f;
+        }
+    }
+}
+
 void dct_1d_optimize(cube_888_f32 *dct, float max_mse, int max_tables)
 {
     dct_optimize(dct, max_mse, max_tables, dct_1d_decode);
@@ -231,6 +412,22 @@ void dct_3d_init_cube_f32(cube_888_f32 *dst, int x, int y, int z)
     }
 }
 
+void dct_8_init()
+{
+    for (int k = 0; k < 8; ++k)
+    {
+        const double factor = k == 0 ? 1.0 : std::numbers::sqrt2;
+
+        for (int c = 0; c < 8; ++c)
+        {
+            const double value = std::cos(std::numbers::pi * k * (c + 0.5) / 8.0) * factor;
+
+            dct_8_basis[k][c] = static_cast<float>(value);
+            dct_8_basis_inverse[c][k] = static_cast<float>(value);
+        }
+    }
+}
+
 void dct_f32_init()
 {
     for (int i = 0; i < std::size(dct_3d_f32.tables); ++i)
@@ -283,6 +480,7 @@ void dct_i8_init_from_f32()
 
 void dct_3d_init_values()
 {
+    dct_8_init();
     dct_f32_init();
     dct_i8_init_from_f32();
 }
@@ -16,10 +16,19 @@ extern dct_tables_888<cube_888_i8> dct_3d_i8;
 void dct_init();
 
 // void dct_3d_encode_fdct(const cube_888_f32 *src, cube_888_f32 *dst); // too much time required for now (5.06.2023)
+// Separable, three passes of 8 point transforms. Weights are in Hilbert order of 3D tables.
 void dct_3d_encode(const cube_888_f32 *src, cube_888_f32 *dst);
 void dct_3d_decode(const cube_888_f32 *src, cube_888_f32 *dst);
+// Full 512 element dot product per weight, reference for the above
+void dct_3d_encode_tables(const cube_888_f32 *src, cube_888_f32 *dst);
+void dct_3d_decode_tables(const cube_888_f32 *src, cube_888_f32 *dst);
 void dct_accumulate_decode_cell(float wgt, const cube_888_f32 *dct, cube_888_f32 *dst);
 void dct_3d_optimize(cube_888_f32 *dct, float max_mse, int max_tables);
+// Zeroes smallest weights while mean squared error they add stays within max_mse, returns count of the rest.
+// Tables are orthonormal, so the error is known without decoding.
+int dct_3d_truncate(cube_888_f32 *dct, float max_mse);
+// Zeroes weights within half of quantization step from zero, decoder then skips their tables
+void dct_snap_to_zero(cube_888_f32 *dct, float step);
 
 // FIXME nothing to gain from these additional steps. Maybe delete.
 void dct_1d_encode(const cube_888_f32 *src, cube_888_f32 *dst);
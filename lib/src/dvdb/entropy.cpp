@@ -0,0 +1,219 @@
+#include "entropy.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+
+namespace dvdb
+{
+namespace
+{
+static constexpr uint32_t PROBABILITY_BITS = 12;
+static constexpr uint32_t PROBABILITY_TOTAL = 1 << PROBABILITY_BITS;
+static constexpr uint32_t STATE_LOWER_BOUND = 1 << 23;
+
+// Table is a 256 bit presence mask followed by uint16 frequency of every present symbol
+static constexpr int PRESENCE_SIZE = 256 / 8;
+
+struct symbol_table
+{
+    uint32_t frequency[256];
+    uint32_t cumulative[256];
+};
+
+void normalize_frequencies(const uint8_t *input, int input_length, symbol_table &table)
+{
+    uint32_t counts[256]{};
+
+    for (int i = 0; i < input_length; ++i)
+    {
+        ++counts[input[i]];
+    }
+
+    int64_t sum = 0;
+
+    for (int s = 0; s < 256; ++s)
+    {
+        table.frequency[s] = counts[s] == 0 ? 0 : std::max<uint32_t>(1, static_cast<uint64_t>(counts[s]) * PROBABILITY_TOTAL / input_length);
+        sum += table.frequency[s];
+    }
+
+    // Rounding leaves sum off by a few, take it from or give it to the most frequent symbols
+    while (sum != PROBABILITY_TOTAL)
+    {
+        const auto largest = std::max_element(std::begin(table.frequency), std::end(table.frequency));
+
+        // Largest is at least PROBABILITY_TOTAL / 256, never drops to zero
+        if (sum > PROBABILITY_TOTAL)
+        {
+            --*largest;
+            --sum;
+        }
+        else
+        {
+            ++*largest;
+            ++sum;
+        }
+    }
+
+    uint32_t cumulative = 0;
+
+    for (int s = 0; s < 256; ++s)
+    {
+        table.cumulative[s] = cumulative;
+        cumulative += table.frequency[s];
+    }
+}
+
+int table_size(const symbol_table &table)
+{
+    return PRESENCE_SIZE + sizeof(uint16_t) * std::count_if(std::begin(table.frequency), std::end(table.frequency), [](uint32_t f) { return f != 0; });
+}
+} // namespace
+
+int rans_compress_stream(const char *input, int input_length, char *output, int output_length)
+{
+    if (input_length == 0)
+    {
+        return 0;
+    }
+
+    const auto *src = reinterpret_cast<const uint8_t *>(input);
+    auto *dst = reinterpret_cast<uint8_t *>(output);
+
+    symbol_table table;
+    normalize_frequencies(src, input_length, table);
+
+    const int header_size = table_size(table) + sizeof(uint32_t);
+
+    if (output_length < header_size)
+    {
+        return -1;
+    }
+
+    std::memset(dst, 0, PRESENCE_SIZE);
+    auto *table_ptr = dst + PRESENCE_SIZE;
+
+    for (int s = 0; s < 256; ++s)
+    {
+        if (table.frequency[s] != 0)
+        {
+            dst[s / 8] |= 1 << (s % 8);
+
+            // Full probability fits in 12 bits only as 0, single symbol streams are the one case reaching it
+            const uint16_t frequency = table.frequency[s] & (PROBABILITY_TOTAL - 1);
+            std::memcpy(table_ptr, &frequency, sizeof(frequency));
+            table_ptr += sizeof(frequency);
+        }
+    }
+
+    // rANS is last in first out, emit bytes backwards from the end and move them after the header
+    uint8_t *const stream_end = dst + output_length;
+    uint8_t *stream_ptr = stream_end;
+    uint32_t state = STATE_LOWER_BOUND;
+
+    for (int i = input_length - 1; i >= 0; --i)
+    {
+        const uint32_t frequency = table.frequency[src[i]];
+        const uint32_t state_max = ((STATE_LOWER_BOUND >> PROBABILITY_BITS) << 8) * frequency;
+
+        while (state >= state_max)
+        {
+            if (stream_ptr == table_ptr + sizeof(uint32_t))
+            {
+                return -1;
+            }
+
+            *--stream_ptr = static_cast<uint8_t>(state & 0xff);
+            state >>= 8;
+        }
+
+        state = ((state / frequency) << PROBABILITY_BITS) + (state % frequency) + table.cumulative[src[i]];
+    }
+
+    std::memcpy(table_ptr, &state, sizeof(state));
+
+    const auto stream_size = stream_end - stream_ptr;
+    std::memmove(table_ptr + sizeof(state), stream_ptr, stream_size);
+
+    return header_size + static_cast<int>(stream_size);
+}
+
+int rans_decompress_stream(const char *input, int input_length, char *output, int output_length)
+{
+    if (output_length == 0)
+    {
+        return 0;
+    }
+
+    const auto *src = reinterpret_cast<const uint8_t *>(input);
+    const auto *src_end = src + input_length;
+    auto *dst = reinterpret_cast<uint8_t *>(output);
+
+    if (input_length < PRESENCE_SIZE)
+    {
+        return -1;
+    }
+
+    symbol_table table{};
+    uint8_t slot_symbols[PROBABILITY_TOTAL];
+
+    const auto *table_ptr = src + PRESENCE_SIZE;
+    uint32_t cumulative = 0;
+
+    for (int s = 0; s < 256; ++s)
+    {
+        if ((src[s / 8] & (1 << (s % 8))) == 0)
+        {
+            continue;
+        }
+
+        if (table_ptr + sizeof(uint16_t) > src_end)
+        {
+            return -1;
+        }
+
+        uint16_t frequency;
+        std::memcpy(&frequency, table_ptr, sizeof(frequency));
+        table_ptr += sizeof(frequency);
+
+        table.frequency[s] = frequency == 0 ? PROBABILITY_TOTAL : frequency;
+        table.cumulative[s] = cumulative;
+
+        if (cumulative + table.frequency[s] > PROBABILITY_TOTAL)
+        {
+            return -1;
+        }
+
+        std::fill_n(slot_symbols + cumulative, table.frequency[s], static_cast<uint8_t>(s));
+        cumulative += table.frequency[s];
+    }
+
+    if (cumulative != PROBABILITY_TOTAL || table_ptr + sizeof(uint32_t) > src_end)
+    {
+        return -1;
+    }
+
+    uint32_t state;
+    std::memcpy(&state, table_ptr, sizeof(state));
+
+    const auto *stream_ptr = table_ptr + sizeof(state);
+
+    for (int i = 0; i < output_length; ++i)
+    {
+        const uint32_t slot = state & (PROBABILITY_TOTAL - 1);
+        const uint8_t symbol = slot_symbols[slot];
+
+        dst[i] = symbol;
+        state = table.frequency[symbol] * (state >> PROBABILITY_BITS) + slot - table.cumulative[symbol];
+
+        while (state < STATE_LOWER_BOUND && stream_ptr < src_end)
+        {
+            state = (state << 8) | *stream_ptr++;
+        }
+    }
+
+    return stream_ptr == src_end ? output_length : -1;
+}
+} // namespace dvdb
@@ -0,0 +1,10 @@
+#pragma once
+
+namespace dvdb
+{
+// Order-0 rANS over bytes, suits streams of small symbols without long repeats (modes, vectors, residuals).
+// Same conventions as compress_stream: returns written size or negative value when output is too small.
+int rans_compress_stream(const char *input, int input_length, char *output, int output_length);
+// output_length must be exactly the original length
+int rans_decompress_stream(const char *input, int input_length, char *output, int output_length);
+} // namespace dvdb
@@ -0,0 +1,93 @@
+#include "mask.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace dvdb
+{
+namespace
+{
+using mode_e = code_points::mask_mode::mode_e;
+using flip_position = uint16_t;
+} // namespace
+
+size_t encode_mask(const cube_888_mask *predicted, const cube_888_mask *mask, uint8_t *output)
+{
+    const auto flipped = predicted->values ^ mask->values;
+    const auto flip_count = flipped.count();
+
+    if (flip_count == 0)
+    {
+        output[0] = static_cast<uint8_t>(mode_e::UNCHANGED);
+        return sizeof(code_points::mask_mode);
+    }
+
+    if (flip_count > code_points::mask_mode::MAX_FLIPS)
+    {
+        output[0] = static_cast<uint8_t>(mode_e::RAW);
+        std::memcpy(output + sizeof(code_points::mask_mode), mask, sizeof(*mask));
+        return MAX_ENCODED_MASK_SIZE;
+    }
+
+    output[0] = static_cast<uint8_t>(mode_e::FLIPPED);
+    output[1] = static_cast<uint8_t>(flip_count);
+
+    auto *positions = output + 2;
+
+    for (flip_position i = 0; i < flipped.size(); ++i)
+    {
+        if (flipped[i])
+        {
+            std::memcpy(positions, &i, sizeof(i));
+            positions += sizeof(i);
+        }
+    }
+
+    return positions - output;
+}
+
+size_t decode_mask(const uint8_t *input, const cube_888_mask *predicted, cube_888_mask *mask)
+{
+    switch (static_cast<mode_e>(input[0]))
+    {
+    case mode_e::UNCHANGED:
+        *mask = *predicted;
+        return sizeof(code_points::mask_mode);
+    case mode_e::FLIPPED: {
+        const auto flip_count = input[1];
+        const auto *positions = input + 2;
+
+        *mask = *predicted;
+
+        for (int i = 0; i < flip_count; ++i)
+        {
+            flip_position position;
+            std::memcpy(&position, positions + i * sizeof(position), sizeof(position));
+            mask->values.flip(position & (mask->values.size() - 1));
+        }
+
+        return 2 + flip_count * sizeof(flip_position);
+    }
+    case mode_e::RAW:
+        std::memcpy(mask, input + sizeof(code_points::mask_mode), sizeof(*mask));
+        return MAX_ENCODED_MASK_SIZE;
+    }
+
+    throw std::runtime_error("Unknown mask mode!");
+}
+
+size_t encoded_mask_size(const uint8_t *input)
+{
+    switch (static_cast<mode_e>(input[0]))
+    {
+    case mode_e::UNCHANGED:
+        return sizeof(code_points::mask_mode);
+    case mode_e::FLIPPED:
+        return 2 + input[1] * sizeof(flip_position);
+    case mode_e::RAW:
+        return MAX_ENCODED_MASK_SIZE;
+    }
+
+    throw std::runtime_error("Unknown mask mode!");
+}
+} // namespace dvdb
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "types.hpp"
+
+namespace dvdb
+{
+// Largest encoded mask, mode followed by raw mask
+static constexpr size_t MAX_ENCODED_MASK_SIZE = sizeof(code_points::mask_mode) + sizeof(cube_888_mask);
+
+// Codes mask as difference to predicted one in the cheapest mode, returns written size
+size_t encode_mask(const cube_888_mask *predicted, const cube_888_mask *mask, uint8_t *output);
+// Returns read size
+size_t decode_mask(const uint8_t *input, const cube_888_mask *predicted, cube_888_mask *mask);
+size_t encoded_mask_size(const uint8_t *input);
+} // namespace dvdb
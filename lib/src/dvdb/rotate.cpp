@@ -3,6 +3,8 @@
 #include "common.hpp"
 #include "statistics.hpp"
 
+#include <algorithm>
+#include <bitset>
 #include <cstring>
 #include <immintrin.h>
 
@@ -176,17 +178,64 @@ static constexpr dvdb::cube_888_f32 default_mask = filled_cube(1);
 
 float rotate_refill_find_astar(const cube_888_f32 *dst, const cube_888_f32 *dst_mask, cube_888_f32 *src[27], int *x, int *y, int *z)
 {
+    return rotate_refill_find_astar(dst, dst_mask, src, nullptr, 0, x, y, z);
+}
+
+float rotate_refill_find_astar(const cube_888_f32 *dst, const cube_888_f32 *dst_mask, cube_888_f32 *src[27], const rotation_candidate *candidates, int candidate_count, int *x, int *y, int *z)
+{
+    // Search never leaves [-7, 7] and looks one step further
+    static constexpr int SEARCH_LIMIT = 7;
+    static constexpr int SEARCH_RANGE = SEARCH_LIMIT + 1;
+    static constexpr int SEARCH_SIDE = SEARCH_RANGE * 2 + 1;
+
     cube_888_f32 test;
     float test_error_pre_fma[27];
     float test_error[27];
 
+    // Consecutive steps overlap on most of their neighbourhood, so scored offsets are kept
+    std::bitset<SEARCH_SIDE * SEARCH_SIDE * SEARCH_SIDE> evaluated;
+    float cache_error_pre_fma[SEARCH_SIDE * SEARCH_SIDE * SEARCH_SIDE];
+    float cache_error[SEARCH_SIDE * SEARCH_SIDE * SEARCH_SIDE];
+
     if (!dst_mask)
     {
         dst_mask = &default_mask;
     }
 
+    const auto score = [&](int ox, int oy, int oz) {
+        const int cache_index = (ox + SEARCH_RANGE) + SEARCH_SIDE * ((oy + SEARCH_RANGE) + SEARCH_SIDE * (oz + SEARCH_RANGE));
+
+        if (!evaluated[cache_index])
+        {
+            rotate_refill(&test, src, ox, oy, oz);
+
+            float pre_fma_error, post_fma_error;
+            linear_regression_errors_with_mask(&test, dst, dst_mask, &pre_fma_error, &post_fma_error);
+
+            cache_error_pre_fma[cache_index] = pre_fma_error;
+            cache_error[cache_index] = std::min(pre_fma_error, post_fma_error);
+            evaluated[cache_index] = true;
+        }
+
+        return cache_index;
+    };
+
     *x = *y = *z = 0;
 
+    float start_error = cache_error[score(0, 0, 0)];
+
+    for (int i = 0; i < candidate_count; ++i)
+    {
+        const int cx = std::clamp(candidates[i].x, -SEARCH_LIMIT, SEARCH_LIMIT);
+        const int cy = std::clamp(candidates[i].y, -SEARCH_LIMIT, SEARCH_LIMIT);
+        const int cz = std::clamp(candidates[i].z, -SEARCH_LIMIT, SEARCH_LIMIT);
+
+        if (const float error = cache_error[score(cx, cy, cz)]; error < start_error)
+        {
+            *x = cx, *y = cy, *z = cz, start_error = error;
+        }
+    }
+
     while (true)
     {
         int tx, ty, tz;
@@ -194,18 +243,11 @@ float rotate_refill_find_astar(const cube_888_f32 *dst, const cube_888_f32 *dst_
         for (int i = 0; i < 27; ++i)
         {
             index_to_step_offset(i, &tx, &ty, &tz);
-            rotate_refill(&test, src, tx + *x, ty + *y, tz + *z);
-
-            float pre_fma_error = mean_squared_error_with_mask(&test, dst, dst_mask);
 
-            float add, mul;
-            linear_regression(&test, dst, &add, &mul);
-            fma(&test, &test, add, mul);
+            const int cache_index = score(tx + *x, ty + *y, tz + *z);
 
-            float post_fma_error = mean_squared_error_with_mask(&test, dst, dst_mask);
-
-            test_error_pre_fma[i] = pre_fma_error;
-            test_error[i] = std::min(pre_fma_error, post_fma_error);
+            test_error_pre_fma[i] = cache_error_pre_fma[cache_index];
+            test_error[i] = cache_error[cache_index];
         }
 
         int i = min_value27(test_error);
@@ -218,7 +260,7 @@ float rotate_refill_find_astar(const cube_888_f32 *dst, const cube_888_f32 *dst_
 
         *x += tx, *y += ty, *z += tz;
 
-        if (std::abs(*x) > 7 || std::abs(*y) > 7 || std::abs(*z) > 7)
+        if (std::abs(*x) > SEARCH_LIMIT || std::abs(*y) > SEARCH_LIMIT || std::abs(*z) > SEARCH_LIMIT)
         {
             return test_error_pre_fma[i];
         }
@@ -245,13 +287,8 @@ float rotate_refill_find_brute_force(const cube_888_f32 *dst, const cube_888_f32
             {
                 rotate_refill(&test, src, tx, ty, tz);
 
-                float pre_fma_error = mean_squared_error_with_mask(&test, dst, dst_mask);
-
-                float add, mul;
-                linear_regression(&test, dst, &add, &mul);
-                fma(&test, &test, add, mul);
-
-                float post_fma_error = mean_squared_error_with_mask(&test, dst, dst_mask);
+                float pre_fma_error, post_fma_error;
+                linear_regression_errors_with_mask(&test, dst, dst_mask, &pre_fma_error, &post_fma_error);
 
                 float error = std::min(pre_fma_error, post_fma_error);
 
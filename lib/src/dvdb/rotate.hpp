@@ -4,7 +4,14 @@
 
 namespace dvdb
 {
+struct rotation_candidate
+{
+    int x, y, z;
+};
+
 float rotate_refill_find_astar(const cube_888_f32 *dst, const cube_888_f32 *dst_mask, cube_888_f32 *src[27], int *x, int *y, int *z);
+// Starts from the best of (0, 0, 0) and given candidates, e.g. offsets chosen for neighbouring leaves or previous frame
+float rotate_refill_find_astar(const cube_888_f32 *dst, const cube_888_f32 *dst_mask, cube_888_f32 *src[27], const rotation_candidate *candidates, int candidate_count, int *x, int *y, int *z);
 float rotate_refill_find_brute_force(const cube_888_f32 *dst, const cube_888_f32 *dst_mask, cube_888_f32 *src[27], int *x, int *y, int *z);
 void rotate_refill(cube_888_f32 *dst, cube_888_f32 *src[27], int x, int y, int z);
 void rotate_refill(cube_888_mask *dst, cube_888_mask *src[27], int x, int y, int z);
@@ -1,6 +1,7 @@
 #include "statistics.hpp"
 #include "common.hpp"
 
+#include <algorithm>
 #include <immintrin.h>
 #include <iterator>
 
@@ -25,6 +26,14 @@ float accumulate_register_256(__m256 ymm)
 
     return ret;
 }
+
+double accumulate_register_256d(__m256d ymm)
+{
+    __m128d xmm = _mm_add_pd(_mm256_castpd256_pd128(ymm), _mm256_extractf128_pd(ymm, 1));
+    xmm = _mm_add_sd(xmm, _mm_unpackhi_pd(xmm, xmm));
+
+    return _mm_cvtsd_f64(xmm);
+}
 } // namespace
 
 float mean_squared_error(const cube_888_f32 *a, const cube_888_f32 *b)
@@ -157,4 +166,72 @@ void linear_regression_with_mask(const cube_888_f32 *x, const cube_888_f32 *y, f
     *mul = ss_xx == 0 ? 0 : ss_xy / ss_xx;
     *add = y_mean - *mul * x_mean;
 }
+
+void linear_regression_errors_with_mask(const cube_888_f32 *x, const cube_888_f32 *y, const cube_888_f32 *mask, float *pre_fma_error, float *post_fma_error)
+{
+    // Moments are gathered around first values, so large means don't eat float precision
+    __m256 ymm_x0 = _mm256_set1_ps(x->values[0]);
+    __m256 ymm_y0 = _mm256_set1_ps(y->values[0]);
+
+    // Moments go to doubles, in floats near perfect fits lose most of their slope
+    __m256d ymm_sx = _mm256_setzero_pd();
+    __m256d ymm_sy = _mm256_setzero_pd();
+    __m256d ymm_sxx = _mm256_setzero_pd();
+    __m256d ymm_sxy = _mm256_setzero_pd();
+    __m256 ymm_wdd = _mm256_setzero_ps();
+
+#pragma GCC unroll 16
+    for (int i = 0; i < std::size(x->values); i += 8)
+    {
+        __m256 ymm_mask = _mm256_loadu_ps(mask->values + i);
+        __m256 ymm_x = _mm256_sub_ps(_mm256_loadu_ps(x->values + i), ymm_x0);
+        __m256 ymm_y = _mm256_sub_ps(_mm256_loadu_ps(y->values + i), ymm_y0);
+
+        // Regression itself is unmasked
+        for (int half = 0; half < 2; ++half)
+        {
+            __m256d ymm_xd = _mm256_cvtps_pd(half == 0 ? _mm256_castps256_ps128(ymm_x) : _mm256_extractf128_ps(ymm_x, 1));
+            __m256d ymm_yd = _mm256_cvtps_pd(half == 0 ? _mm256_castps256_ps128(ymm_y) : _mm256_extractf128_ps(ymm_y, 1));
+
+            ymm_sx = _mm256_add_pd(ymm_sx, ymm_xd);
+            ymm_sy = _mm256_add_pd(ymm_sy, ymm_yd);
+            ymm_sxx = _mm256_fmadd_pd(ymm_xd, ymm_xd, ymm_sxx);
+            ymm_sxy = _mm256_fmadd_pd(ymm_xd, ymm_yd, ymm_sxy);
+        }
+
+        // Errors are masked, mask is applied to difference so it's squared as well
+        __m256 ymm_diff = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(x->values + i), _mm256_loadu_ps(y->values + i)), ymm_mask);
+        ymm_wdd = _mm256_fmadd_ps(ymm_diff, ymm_diff, ymm_wdd);
+    }
+
+    static constexpr double n = std::size(decltype(x->values){});
+
+    const double sx = accumulate_register_256d(ymm_sx);
+    const double sy = accumulate_register_256d(ymm_sy);
+    const double ss_xx = accumulate_register_256d(ymm_sxx) - sx * sx / n;
+    const double ss_xy = accumulate_register_256d(ymm_sxy) - sx * sy / n;
+
+    // Same fit as linear_regression, but intercept is relative to the shifted origin
+    const double mul = ss_xx == 0 ? 0 : ss_xy / ss_xx;
+    const double add = (sy - mul * sx) / n;
+
+    __m256 ymm_mul = _mm256_set1_ps(static_cast<float>(mul));
+    __m256 ymm_add = _mm256_set1_ps(static_cast<float>(add));
+    __m256 ymm_rr = _mm256_setzero_ps();
+
+    // Residuals are summed directly, expanding them from moments cancels badly on near perfect fits
+#pragma GCC unroll 16
+    for (int i = 0; i < std::size(x->values); i += 8)
+    {
+        __m256 ymm_mask = _mm256_loadu_ps(mask->values + i);
+        __m256 ymm_x = _mm256_sub_ps(_mm256_loadu_ps(x->values + i), ymm_x0);
+        __m256 ymm_y = _mm256_sub_ps(_mm256_loadu_ps(y->values + i), ymm_y0);
+
+        __m256 ymm_residual = _mm256_mul_ps(_mm256_sub_ps(_mm256_fmadd_ps(ymm_x, ymm_mul, ymm_add), ymm_y), ymm_mask);
+        ymm_rr = _mm256_fmadd_ps(ymm_residual, ymm_residual, ymm_rr);
+    }
+
+    *pre_fma_error = accumulate_register_256(ymm_wdd) / n;
+    *post_fma_error = accumulate_register_256(ymm_rr) / n;
+}
 } // namespace dvdb
@@ -11,4 +11,8 @@ float mean_squared_error_with_mask(const cube_888_f32 *a, const cube_888_f32 *b,
 float accumulate(const cube_888_f32 *src);
 void linear_regression(const cube_888_f32 *x, const cube_888_f32 *y, float *add, float *mul);
 void linear_regression_with_mask(const cube_888_f32 *x, const cube_888_f32 *y, float *add, float *mul, const cube_888_f32 *mask);
+
+// Same as mean_squared_error_with_mask of x, and of x fitted by linear_regression. Moments are gathered in one pass,
+// fitted residuals in a second, without storing the fitted cube.
+void linear_regression_errors_with_mask(const cube_888_f32 *x, const cube_888_f32 *y, const cube_888_f32 *mask, float *pre_fma_error, float *post_fma_error);
 } // namespace dvdb
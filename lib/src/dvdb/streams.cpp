@@ -0,0 +1,363 @@
+#include "streams.hpp"
+
+#include "mask.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace dvdb
+{
+namespace
+{
+bool has_reference(headers::main::frame_type_e frame_type)
+{
+    return frame_type == headers::main::frame_type_e::BIDIRECTIONAL_FRAME || frame_type == headers::main::frame_type_e::MULTI_REFERENCE_FRAME;
+}
+
+bool has_source_key(const headers::main &header)
+{
+    return (header.flags & headers::main::IMPLICIT_SOURCE_KEYS) == 0;
+}
+
+uint64_t grid_diff_end(const headers::main *header, uint64_t grid, size_t size)
+{
+    return grid + 1 < header->vdb_grid_count ? header->frames[grid + 1].diff_data_offset_start : size;
+}
+
+class stream_writer
+{
+public:
+    explicit stream_writer(streams &out)
+        : _out(out)
+    {
+    }
+
+    // Keys are delta coded within one grid
+    void begin_grid(const char *begin, const char *end)
+    {
+        _ptr = begin;
+        _end = end;
+        _previous_key = 0;
+    }
+
+    const char *position() const
+    {
+        return _ptr;
+    }
+
+    template <typename T>
+    T take(stream_e stream)
+    {
+        T value;
+        std::memcpy(&value, take_raw(stream, sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    const char *take_raw(stream_e stream, size_t size)
+    {
+        const auto *begin = advance(size);
+        auto &dst = _out[static_cast<size_t>(stream)];
+
+        dst.insert(dst.end(), begin, begin + size);
+
+        return begin;
+    }
+
+    void take_key()
+    {
+        code_points::source_key key;
+        std::memcpy(&key, advance(sizeof(key)), sizeof(key));
+
+        const code_points::source_key delta = key - _previous_key;
+        auto &dst = _out[static_cast<size_t>(stream_e::KEYS)];
+
+        dst.insert(dst.end(), reinterpret_cast<const char *>(&delta), reinterpret_cast<const char *>(&delta) + sizeof(delta));
+        _previous_key = key;
+    }
+
+private:
+    const char *advance(size_t size)
+    {
+        if (_ptr + size > _end)
+        {
+            throw std::runtime_error("Leaf record crosses end of grid diff data!");
+        }
+
+        const auto *begin = _ptr;
+        _ptr += size;
+
+        return begin;
+    }
+
+    const char *_ptr = nullptr;
+    const char *_end = nullptr;
+    streams &_out;
+    code_points::source_key _previous_key = 0;
+};
+
+class stream_reader
+{
+public:
+    stream_reader(const streams &in, std::vector<char> &out)
+        : _in(in), _out(out)
+    {
+    }
+
+    void begin_grid()
+    {
+        _previous_key = 0;
+    }
+
+    template <typename T>
+    T take(stream_e stream)
+    {
+        T value;
+        std::memcpy(&value, take_raw(stream, sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    const char *take_raw(stream_e stream, size_t size)
+    {
+        const auto index = static_cast<size_t>(stream);
+        const auto &src = _in[index];
+
+        if (_cursors[index] + size > src.size())
+        {
+            throw std::runtime_error("Stream ended before its leaf records!");
+        }
+
+        const auto *begin = src.data() + _cursors[index];
+
+        _out.insert(_out.end(), begin, begin + size);
+        _cursors[index] += size;
+
+        return begin;
+    }
+
+    void take_key()
+    {
+        const auto index = static_cast<size_t>(stream_e::KEYS);
+
+        if (_cursors[index] + sizeof(code_points::source_key) > _in[index].size())
+        {
+            throw std::runtime_error("Stream ended before its leaf records!");
+        }
+
+        code_points::source_key delta;
+        std::memcpy(&delta, _in[index].data() + _cursors[index], sizeof(delta));
+        _cursors[index] += sizeof(delta);
+
+        _previous_key += delta;
+        _out.insert(_out.end(), reinterpret_cast<const char *>(&_previous_key), reinterpret_cast<const char *>(&_previous_key) + sizeof(_previous_key));
+    }
+
+private:
+    const streams &_in;
+    std::vector<char> &_out;
+    std::array<size_t, STREAM_COUNT> _cursors{};
+    code_points::source_key _previous_key = 0;
+};
+
+// Moves one leaf record between interleaved layout and streams, io is stream_writer or stream_reader
+template <typename T>
+void transfer_record(T &io, const headers::main &header)
+{
+    const auto setup = io.template take<code_points::setup>(stream_e::MODES);
+
+    if (has_reference(header.frame_type))
+    {
+        io.take_raw(stream_e::MODES, sizeof(code_points::reference));
+    }
+
+    if (setup.has_source && has_source_key(header))
+    {
+        io.take_key();
+    }
+
+    if (setup.has_rotation)
+    {
+        io.take_raw(stream_e::VECTORS, sizeof(code_points::rotation_offset));
+    }
+
+    if (setup.has_fma_and_new_mask)
+    {
+        io.take_raw(stream_e::PARAMS, sizeof(code_points::fma));
+
+        if (header.flags & headers::main::PREDICTED_MASKS)
+        {
+            using mode_e = code_points::mask_mode::mode_e;
+
+            const auto [mode] = io.template take<code_points::mask_mode>(stream_e::MODES);
+
+            if (mode == mode_e::FLIPPED)
+            {
+                const auto flip_count = io.template take<uint8_t>(stream_e::MODES);
+                io.take_raw(stream_e::MASKS, flip_count * sizeof(uint16_t));
+            }
+            else if (mode == mode_e::RAW)
+            {
+                io.take_raw(stream_e::MASKS, sizeof(cube_888_mask));
+            }
+        }
+        else
+        {
+            io.take_raw(stream_e::MASKS, sizeof(cube_888_mask));
+        }
+    }
+
+    if (setup.has_values)
+    {
+        io.take_raw(stream_e::PARAMS, sizeof(code_points::quantization));
+    }
+
+    if (setup.has_map)
+    {
+        io.take_raw(stream_e::PARAMS, sizeof(code_points::map));
+    }
+
+    if (setup.has_values)
+    {
+        io.take_raw(stream_e::RESIDUALS, sizeof(cube_888_i8));
+    }
+}
+} // namespace
+
+size_t leaf_record_size(const void *record, const headers::main &header)
+{
+    const auto *bytes = static_cast<const uint8_t *>(record);
+
+    code_points::setup setup;
+    std::memcpy(&setup, bytes, sizeof(setup));
+
+    size_t size = sizeof(code_points::setup);
+
+    if (header.frame_type == headers::main::frame_type_e::BIDIRECTIONAL_FRAME)
+    {
+        size += sizeof(code_points::reference);
+    }
+    else if (header.frame_type == headers::main::frame_type_e::MULTI_REFERENCE_FRAME)
+    {
+        size += sizeof(code_points::reference_index);
+    }
+
+    if (setup.has_source && has_source_key(header))
+    {
+        size += sizeof(code_points::source_key);
+    }
+
+    if (setup.has_rotation)
+    {
+        size += sizeof(code_points::rotation_offset);
+    }
+
+    if (setup.has_fma_and_new_mask)
+    {
+        size += sizeof(code_points::fma);
+        size += header.flags & headers::main::PREDICTED_MASKS ? encoded_mask_size(bytes + size) : sizeof(cube_888_mask);
+    }
+
+    if (setup.has_values)
+    {
+        size += sizeof(code_points::quantization) + sizeof(cube_888_i8);
+    }
+
+    if (setup.has_map)
+    {
+        size += sizeof(code_points::map);
+    }
+
+    return size;
+}
+
+void split_streams(const char *file, size_t size, streams &out)
+{
+    const auto *header = reinterpret_cast<const headers::main *>(file);
+
+    for (auto &stream : out)
+    {
+        stream.clear();
+    }
+
+    if (header->frame_type == headers::main::frame_type_e::KEY_FRAME)
+    {
+        out[static_cast<size_t>(stream_e::BASE)].assign(file, file + size);
+        return;
+    }
+
+    const auto base_size = header->vdb_grid_count > 0 ? header->frames[0].diff_data_offset_start : size;
+    out[static_cast<size_t>(stream_e::BASE)].assign(file, file + base_size);
+
+    stream_writer writer(out);
+
+    for (uint64_t i = 0; i < header->vdb_grid_count; ++i)
+    {
+        const auto *end = file + grid_diff_end(header, i, size);
+        writer.begin_grid(file + header->frames[i].diff_data_offset_start, end);
+
+        while (writer.position() < end)
+        {
+            transfer_record(writer, *header);
+        }
+    }
+}
+
+std::vector<char> join_streams(streams in)
+{
+    std::vector<char> out;
+    join_streams(in, out);
+    return out;
+}
+
+void join_streams(streams &in, std::vector<char> &out)
+{
+    auto &base = in[static_cast<size_t>(stream_e::BASE)];
+
+    if (base.size() < sizeof(headers::main))
+    {
+        throw std::runtime_error("Base stream is missing the header!");
+    }
+
+    headers::main header;
+    std::memcpy(&header, base.data(), sizeof(header));
+
+    if (header.frame_type == headers::main::frame_type_e::KEY_FRAME)
+    {
+        out.swap(base);
+        return;
+    }
+
+    size_t size = 0;
+
+    for (const auto &stream : in)
+    {
+        size += stream.size();
+    }
+
+    out.clear();
+    out.reserve(size);
+    out.insert(out.end(), base.begin(), base.end());
+
+    stream_reader reader(in, out);
+
+    for (uint64_t i = 0; i < header.vdb_grid_count; ++i)
+    {
+        if (out.size() != header.frames[i].diff_data_offset_start)
+        {
+            throw std::runtime_error("Streams do not match grid offsets!");
+        }
+
+        const auto end = grid_diff_end(&header, i, size);
+        reader.begin_grid();
+
+        while (out.size() < end)
+        {
+            transfer_record(reader, header);
+        }
+    }
+
+    if (out.size() != size)
+    {
+        throw std::runtime_error("Streams hold more data than their leaf records!");
+    }
+}
+} // namespace dvdb
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "types.hpp"
+
+#include <array>
+#include <vector>
+
+namespace dvdb
+{
+// Leaf records of diff frames split by kind, every stream then gets the codec that suits it best
+enum class stream_e : uint32_t
+{
+    BASE,      // header and leafless base trees, kept as they are
+    MODES,     // setup, reference and mask mode code points
+    KEYS,      // explicit source keys, delta to the previous key
+    VECTORS,   // rotation offsets
+    PARAMS,    // fma, quantization and map
+    MASKS,     // new masks or their flipped bits
+    RESIDUALS, // i8 values
+    COUNT,
+};
+
+static constexpr size_t STREAM_COUNT = static_cast<size_t>(stream_e::COUNT);
+
+using streams = std::array<std::vector<char>, STREAM_COUNT>;
+
+// Size of one leaf record of diff data
+size_t leaf_record_size(const void *record, const headers::main &header);
+
+// Key frames have no leaf records and go to BASE as a whole
+void split_streams(const char *file, size_t size, streams &out);
+// Takes the streams over, key frames hand BASE back without copying
+std::vector<char> join_streams(streams in);
+// Same into out, whose memory is reused. Key frames swap BASE with out instead.
+void join_streams(streams &in, std::vector<char> &out);
+} // namespace dvdb
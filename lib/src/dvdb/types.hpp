@@ -16,7 +16,10 @@
 namespace dvdb
 {
 static constexpr uint64_t MAGIC_NUMBER = 0x42445666666944; // DiffVDB
+static constexpr uint64_t CONTAINER_MAGIC_NUMBER = 0x5342445666666944; // DiffVDBS
 static constexpr uint64_t MAX_SUPPORTED_GRID_COUNT = 4;
+static constexpr uint64_t MAX_REFERENCE_FRAMES = 3; // previous anchor and the ones before it
+static constexpr uint64_t PREDICTOR_RESET_INTERVAL = 256; // leaves, records predicted from previous leaf restart at every multiple
 
 template <typename T>
 struct cube_888
@@ -56,14 +59,26 @@ namespace headers
 
 struct main
 {
-    enum class frame_type_e : uint64_t
+    enum class frame_type_e : uint32_t
     {
         KEY_FRAME,
         DIFF_FRAME,
+        BIDIRECTIONAL_FRAME,   // predicted from previous and next key/diff frame, never a source itself
+        MULTI_REFERENCE_FRAME, // diff frame whose leaves may come from older anchors too
+    };
+
+    // Layout of leaf records, files written before these existed have none set
+    enum flags_e : uint32_t
+    {
+        IMPLICIT_SOURCE_KEYS = 1 << 0, // source key is always the leaf's own key and is not written
+        DELTA_ROTATIONS = 1 << 1,      // rotation offset is relative to the previous leaf's rotation
+        PREDICTED_MASKS = 1 << 2,      // new masks are coded against rotated source mask, see code_points::mask_mode
+        BUNDLE_INDEX = 1 << 3,         // base trees are followed by bundle_index of every grid
     };
 
     uint64_t magic = MAGIC_NUMBER; // DiffVDB
     frame_type_e frame_type;       // key and diff frames
+    uint32_t flags;                // flags_e, frame_type used to be 64 bit so old files read as zero
     uint64_t vdb_grid_count;       // how many grids in this file
     uint64_t vdb_required_size;    // how much data to allocate for final vsb
 
@@ -76,6 +91,13 @@ struct main
     } frames[MAX_SUPPORTED_GRID_COUNT];
 };
 
+// Where every PREDICTOR_RESET_INTERVAL leaves of a grid start, records there decode without the ones before them
+struct bundle_index
+{
+    uint64_t bundle_count; // leaf count divided by PREDICTOR_RESET_INTERVAL, rounded up
+    // followed by bundle_count uint64_t offsets relative to diff_data_offset_start of the grid
+};
+
 struct nvdb_block_description
 {
     uint64_t compressed_size;
@@ -88,6 +110,44 @@ struct nvdb_block_description
 
 struct block_description
 {
+    // Flag in compressed_size, block is a table of stream_description followed by data of every stream
+    static constexpr uint64_t SPLIT_STREAMS = 1ull << 63;
+
+    uint64_t compressed_size;
+    uint64_t uncompressed_size;
+};
+
+// Single file animation, header is followed by container_frame of every frame and then packed frames themselves
+struct container
+{
+    uint64_t magic = CONTAINER_MAGIC_NUMBER; // DiffVDBS
+    uint64_t frame_count;
+    uint64_t max_uncompressed_size; // largest block_description::uncompressed_size, sizes decoder buffers up front
+    uint64_t _padding;
+};
+
+struct container_frame
+{
+    uint64_t offset;                // of packed frame in container, starts with its block_description
+    uint64_t size;                  // of packed frame
+    uint64_t uncompressed_size;     // same as in its block_description
+    main::frame_type_e frame_type;
+    uint32_t keyframe;              // index of last key frame at or before this one, decoding can start there
+};
+
+// Describes a stream and every block of it. Streams with blocks are coded block by block, the block
+// descriptions of all streams follow the stream ones, and data of all blocks follows in the same order.
+struct stream_description
+{
+    enum class codec_e : uint32_t
+    {
+        RAW,
+        LZ4,
+        RANS,
+    };
+
+    codec_e codec;        // unused by streams with blocks
+    uint32_t block_count; // 0 means stream is a single block itself
     uint64_t compressed_size;
     uint64_t uncompressed_size;
 };
@@ -114,6 +174,12 @@ struct rotation_offset
     int16_t z : 5;
 };
 
+// Rotation deltas are coded modulo 32. Rotations stay within [-8, 8], so the 5 bit field wraps back to the exact value.
+constexpr int wrap_rotation(int value)
+{
+    return ((value + 16) & 31) - 16;
+}
+
 struct fma
 {
     static constexpr auto range = 8;
@@ -154,6 +220,40 @@ struct quantization
     uint8_t value;
 };
 
+// Bidirectional frames only, follows setup of every leaf
+struct reference
+{
+    enum class source_e : uint8_t
+    {
+        PREVIOUS,
+        NEXT,
+        AVERAGE, // values of both averaged, masks joined
+    };
+
+    source_e source;
+};
+
+// Multi reference frames only, follows setup of every leaf. 0 is the previous anchor, 1 the one before...
+struct reference_index
+{
+    uint8_t value;
+};
+
+// Replaces raw new mask in frames with PREDICTED_MASKS
+struct mask_mode
+{
+    static constexpr int MAX_FLIPS = 31; // more than this is cheaper as raw mask
+
+    enum class mode_e : uint8_t
+    {
+        UNCHANGED, // predicted mask as it is
+        FLIPPED,   // flip count followed by uint16 position of every bit differing from prediction
+        RAW,       // whole cube_888_mask
+    };
+
+    mode_e mode;
+};
+
 using source_key = uint64_t;
 // using dct_index = uint32_t;
 } // namespace code_points
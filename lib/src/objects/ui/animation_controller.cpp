@@ -6,6 +6,8 @@
 #include <scene/object_context.hpp>
 #include <utils/memory_counter.hpp>
 
+#include <algorithm>
+
 namespace objects::ui
 {
 animation_controller::animation_controller(std::shared_ptr<vdb::volume_resource_base> resource)
@@ -67,6 +69,22 @@ void animation_controller::update(scene::object_context &ctx, float)
 
         ImGui::Text("Current frame: %lu", _volume_resource->get_current_frame());
 
+        {
+            // Diff frames seek from their key frame, see diff_vdb_resource::prepare_seek. That can take a whole GOP, so
+            // dragging only moves the slider and the seek happens once it's released.
+            int frame = _scrub_frame >= 0 ? _scrub_frame : static_cast<int>(_volume_resource->get_current_frame());
+            const int last_frame = static_cast<int>(_volume_resource->get_frame_count()) - 1;
+
+            ImGui::SliderInt("Frame", &frame, 0, std::max(last_frame, 0));
+
+            if (ImGui::IsItemDeactivatedAfterEdit())
+            {
+                _volume_resource->seek(ctx, frame);
+            }
+
+            _scrub_frame = ImGui::IsItemActive() ? frame : -1;
+        }
+
         {
             int frame_rate = _volume_resource->get_frame_rate();
             ImGui::SliderInt("Frame rate", &frame_rate, 1, 30);
@@ -19,5 +19,6 @@ public:
 
 private:
     std::shared_ptr<vdb::volume_resource_base> _volume_resource;
+    int _scrub_frame = -1; // Slider position while dragging, seek happens on release
 };
 } // namespace objects::ui
@@ -11,7 +11,6 @@
 #include <imgui.h>
 
 #include <algorithm>
-#include <regex>
 
 namespace objects::ui
 {
@@ -31,6 +30,8 @@ convert_nvdb_dvdb::job_result convert_nvdb_dvdb_job(std::vector<std::filesystem:
 
     if (files.empty())
     {
+        converter->flush();
+
         res.finished = true;
         res.description = "All conversions have been finished.";
         res.progress = 1.f;
@@ -42,10 +43,14 @@ convert_nvdb_dvdb::job_result convert_nvdb_dvdb_job(std::vector<std::filesystem:
 
     size_t current_processed_count = initial_count - files.size();
 
-    bool make_keyframe = (current_processed_count - 1) % 30 == 0;
-
     res.progress = 1.f - (static_cast<float>(files.size()) / initial_count);
 
+    // Next frame gets decompressed while this one is encoded
+    if (!files.empty())
+    {
+        converter->prefetch_frame(files.back());
+    }
+
     std::function next_job = [files = std::move(files), initial_count, thread_pool, converter]() -> convert_nvdb_dvdb::job_result {
         return convert_nvdb_dvdb_job(std::move(files), initial_count, thread_pool, converter);
     };
@@ -65,6 +70,7 @@ convert_nvdb_dvdb::job_result convert_nvdb_dvdb_job(std::vector<std::filesystem:
 void convert_nvdb_dvdb::init(scene::object_context &ctx)
 {
     dvdb_converter = std::make_shared<converter::dvdb_converter>(ctx.generic_thread_pool_sptr(), _max_error);
+    dvdb_converter->set_keyframe_interval(KEYFRAME_INTERVAL);
 
     std::function directory_job = [path = _working_path, thread_pool = ctx.generic_thread_pool_sptr(), converter = dvdb_converter]() mutable -> job_result {
         job_result res;
@@ -79,35 +85,9 @@ void convert_nvdb_dvdb::init(scene::object_context &ctx)
 
         size_t initial_count = files.size();
 
-        using regex_type = std::basic_regex<std::filesystem::path::value_type>;
-
-#if VANIM_WINDOWS
-        static constexpr auto regex_pattern = L"^.*[\\/\\\\].+_(\\d+)\\.nvdb$";
-        using match_type = std::wcmatch;
-#else
-        static constexpr auto regex_pattern = "^.*[\\/\\\\].+_(\\d+)\\.nvdb$";
-        using match_type = std::cmatch;
-#endif
-
-        regex_type regex(regex_pattern);
-
-        std::sort(files.begin(), files.end(), [&](const std::filesystem::path &lhs, const std::filesystem::path &rhs) -> bool {
-            match_type cm;
-
-            int lhs_index{}, rhs_index{};
-
-            if (std::regex_search(lhs.c_str(), cm, regex))
-            {
-                lhs_index = std::stoi(cm[1]);
-            }
-
-            if (std::regex_search(rhs.c_str(), cm, regex))
-            {
-                rhs_index = std::stoi(cm[1]);
-            }
-
-            return lhs_index > rhs_index;
-        });
+        // Jobs take files from the back
+        converter::sort_files_by_frame_number(files);
+        std::reverse(files.begin(), files.end());
 
         std::function converter_job = [files = std::move(files), initial_count, thread_pool, converter]() mutable -> job_result {
             return convert_nvdb_dvdb_job(std::move(files), initial_count, thread_pool, converter);
@@ -125,7 +105,19 @@ void convert_nvdb_dvdb::init(scene::object_context &ctx)
 
 void convert_nvdb_dvdb::update(scene::object_context &ctx, float)
 {
-    if (_current_status.finished && dvdb_converter->finished())
+    bool compressions_finished = false;
+
+    try
+    {
+        compressions_finished = dvdb_converter->finished();
+    }
+    catch (std::exception &e)
+    {
+        ctx.add_object(std::make_shared<popup>(u8"Error", reinterpret_cast<const char8_t *>(e.what())));
+        return destroy();
+    }
+
+    if (_current_status.finished && compressions_finished)
     {
         _current_status.description += "\n\nCompression ratio: " + std::to_string(dvdb_converter->current_compression_ratio());
 
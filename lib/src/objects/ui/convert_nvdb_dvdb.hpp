@@ -36,6 +36,8 @@ public:
     };
 
 private:
+    static constexpr int KEYFRAME_INTERVAL = 30;
+
     std::shared_ptr<converter::dvdb_converter> dvdb_converter;
     std::filesystem::path _working_path;
     job_result _current_status;
@@ -1,20 +1,24 @@
 #include "diff_vdb_resource.hpp"
 
 #include <converter/dvdb_compressor.hpp>
+#include <converter/dvdb_container.hpp>
 #include <converter/dvdb_converter_nvdb.hpp>
 
 #include <dvdb/common.hpp>
 #include <dvdb/compression.hpp>
 #include <dvdb/dct.hpp>
 #include <dvdb/derivative.hpp>
+#include <dvdb/mask.hpp>
 #include <dvdb/rotate.hpp>
 #include <dvdb/statistics.hpp>
+#include <dvdb/streams.hpp>
 #include <dvdb/types.hpp>
 #include <scene/object_context.hpp>
 #include <utils/future_helpers.hpp>
 #include <utils/gpu_memcpy.hpp>
 #include <utils/memory_counter.hpp>
 #include <utils/nvdb_mmap.hpp>
+#include <utils/read_ahead.hpp>
 #include <utils/scope_guard.hpp>
 #include <utils/thread_pool.hpp>
 #include <utils/utf8_exception.hpp>
@@ -23,6 +27,7 @@
 #include <cstring>
 #include <iostream>
 #include <regex>
+#include <span>
 
 #include <nanovdb/PNanoVDB.h>
 
@@ -42,7 +47,27 @@ void diff_vdb_resource::on_destroy(scene::object_context &ctx)
 
 diff_vdb_resource::diff_vdb_resource(std::filesystem::path path)
     : _resource_directory(path)
+    , _read_ahead(std::make_unique<utils::read_ahead>())
 {
+    // Container is preferred over loose frames next to it
+    if (std::filesystem::is_directory(path))
+    {
+        for (const auto &entry : std::filesystem::directory_iterator(path))
+        {
+            if (entry.is_regular_file() && entry.path().extension() == ".dvdbs")
+            {
+                path = entry.path();
+                break;
+            }
+        }
+    }
+
+    if (std::filesystem::is_regular_file(path) && path.extension() == ".dvdbs")
+    {
+        _container = std::make_unique<converter::dvdb_container>(path);
+        return;
+    }
+
     std::vector<std::pair<int, std::filesystem::path>> dvdb_files;
 
     using regex_type = std::basic_regex<std::filesystem::path::value_type>;
@@ -100,22 +125,73 @@ void diff_vdb_resource::init(scene::object_context &ctx)
 
     size_t max_buffer_size = 0;
 
-    for (const auto &[n, path] : _dvdb_frames)
+    if (_container)
     {
-        mio::mmap_source mmap(path.c_str());
+        // Index has every size, frames aren't touched until played
+        max_buffer_size = _container->max_uncompressed_size();
 
-        const auto header = reinterpret_cast<const dvdb::headers::block_description *>(mmap.data());
+        for (size_t i = 0; i < _container->frame_count(); ++i)
+        {
+            _frames.emplace_back(frame{
+                .path = _resource_directory.string(),
+                .block_number = 0,
+                .number = _frames.size(),
+            });
 
-        if (header->uncompressed_size > max_buffer_size)
+            _keyframes.push_back(_container->frame(i).keyframe);
+        }
+    }
+
+    if (!_dvdb_frames.empty())
+    {
+        // Loose frames keep their type in the main header, which may need the whole frame unpacked to read
+        std::vector<size_t> uncompressed_sizes(_dvdb_frames.size());
+        std::vector<uint8_t> is_keyframe(_dvdb_frames.size());
+
+        auto &thread_pool = ctx.generic_thread_pool();
+        const size_t task_count = std::min<size_t>(std::max(thread_pool.worker_count(), 1), _dvdb_frames.size());
+
+        std::vector<std::future<void>> signals;
+
+        for (size_t t = 0; t < task_count; ++t)
         {
-            max_buffer_size = header->uncompressed_size;
+            signals.emplace_back(thread_pool.enqueue([&, t]() {
+                for (size_t n = t; n < _dvdb_frames.size(); n += task_count)
+                {
+                    mio::mmap_source mmap(_dvdb_frames[n].second.string());
+
+                    uncompressed_sizes[n] = reinterpret_cast<const dvdb::headers::block_description *>(mmap.data())->uncompressed_size;
+                    is_keyframe[n] = converter::peek_dvdb_header(mmap.data(), mmap.size()).frame_type == dvdb::headers::main::frame_type_e::KEY_FRAME;
+                }
+            }));
         }
 
-        _frames.emplace_back(frame{
-            .path = path.string(),
-            .block_number = 0,
-            .number = _frames.size(),
-        });
+        thread_pool.work_together();
+
+        for (auto &signal : signals)
+        {
+            signal.get();
+        }
+
+        uint32_t keyframe = 0;
+
+        for (size_t n = 0; n < _dvdb_frames.size(); ++n)
+        {
+            max_buffer_size = std::max(max_buffer_size, uncompressed_sizes[n]);
+
+            if (is_keyframe[n])
+            {
+                keyframe = static_cast<uint32_t>(n);
+            }
+
+            _keyframes.push_back(keyframe);
+
+            _frames.emplace_back(frame{
+                .path = _dvdb_frames[n].second.string(),
+                .block_number = 0,
+                .number = _frames.size(),
+            });
+        }
     }
 
     static constexpr auto ALIGNMENT = 64;
@@ -124,6 +200,7 @@ void diff_vdb_resource::init(scene::object_context &ctx)
 
     _current_state.resize(max_buffer_size);
     _created_state.resize(max_buffer_size);
+    _next_anchor_state.resize(max_buffer_size);
 
     _ssbo_block_size = max_buffer_size;
     _ssbo_block_count = MAX_BLOCKS;
@@ -134,7 +211,7 @@ void diff_vdb_resource::init(scene::object_context &ctx)
 
     _ssbo_ptr = reinterpret_cast<std::byte *>(glMapNamedBufferRange(_ssbo, 0, _ssbo_block_size * MAX_BLOCKS, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_FLUSH_EXPLICIT_BIT));
 
-    for (int i = 0; i < MAX_BLOCKS && i < _dvdb_frames.size(); ++i)
+    for (int i = 0; i < MAX_BLOCKS && i < frame_count(); ++i)
     {
         schedule_frame(ctx, i, i);
     }
@@ -151,12 +228,38 @@ T read(uint8_t *&data)
 static dvdb::cube_888_mask empty_mask{};
 static dvdb::cube_888_f32 empty_values{};
 
-void grid_reconstruction_worker(int index, void *diff_ptr, int bundle_size, const converter::nvdb_reader &dst_accessor, const converter::nvdb_reader &src_accessor)
+// Bidirectional frames get previous and next anchor as sources, others previous anchor followed by older ones
+// Bundles start at a multiple of PREDICTOR_RESET_INTERVAL leaves
+void grid_reconstruction_worker(int index, void *diff_ptr, int bundle_size, const dvdb::headers::main &header, const converter::nvdb_reader &dst_accessor, std::span<const converter::nvdb_reader> sources)
 {
+    using source_e = dvdb::code_points::reference::source_e;
+    using frame_type_e = dvdb::headers::main::frame_type_e;
+
+    const auto frame_type = header.frame_type;
+    const bool implicit_source_keys = header.flags & dvdb::headers::main::IMPLICIT_SOURCE_KEYS;
+    const bool delta_rotations = header.flags & dvdb::headers::main::DELTA_ROTATIONS;
+    const bool predicted_masks = header.flags & dvdb::headers::main::PREDICTED_MASKS;
+
+    glm::ivec3 previous_rotation(0);
+
+    const auto &src_accessor = sources[0];
+    const auto next_accessor = frame_type == frame_type_e::BIDIRECTIONAL_FRAME ? &sources[1] : nullptr;
+
     auto *diff_current_ptr = reinterpret_cast<uint8_t *>(diff_ptr);
 
     dvdb::cube_888_f32 *src_neighbor_values_ptrs[27];
     dvdb::cube_888_mask *src_neighbor_masks_ptrs[27];
+    dvdb::cube_888_f32 *next_neighbor_values_ptrs[27];
+    dvdb::cube_888_mask *next_neighbor_masks_ptrs[27];
+
+    std::unique_ptr<dvdb::cube_888_f32[]> average_values;
+    std::unique_ptr<dvdb::cube_888_mask[]> average_masks;
+
+    if (next_accessor)
+    {
+        average_values = std::make_unique<dvdb::cube_888_f32[]>(27);
+        average_masks = std::make_unique<dvdb::cube_888_mask[]>(27);
+    }
 
     for (int i = 0; i < bundle_size; ++i)
     {
@@ -164,31 +267,105 @@ void grid_reconstruction_worker(int index, void *diff_ptr, int bundle_size, cons
 
         const auto setup_as_byte = *reinterpret_cast<const uint8_t *>(&setup);
 
+        auto reference = source_e::PREVIOUS;
+        size_t reference_index = 0;
+
+        if (frame_type == frame_type_e::BIDIRECTIONAL_FRAME)
+        {
+            reference = read<dvdb::code_points::reference>(diff_current_ptr).source;
+            reference_index = reference == source_e::NEXT ? 1 : 0;
+        }
+        else if (frame_type == frame_type_e::MULTI_REFERENCE_FRAME)
+        {
+            reference_index = read<dvdb::code_points::reference_index>(diff_current_ptr).value;
+
+            if (reference_index >= sources.size())
+            {
+                throw std::runtime_error("Leaf refers to unavailable reference frame!");
+            }
+        }
+
+        const auto &accessor = sources[reference_index];
+
+        // Predicted masks start from the rotated source mask, raw ones replace it
+        const bool needs_source_mask = !setup.has_fma_and_new_mask || predicted_masks;
+
+        dvdb::code_points::source_key source = 0;
+
+        if (setup.has_source)
+        {
+            source = implicit_source_keys ? dst_accessor.leaf_key(i + index) : read<dvdb::code_points::source_key>(diff_current_ptr);
+        }
+
+        if ((i + index) % dvdb::PREDICTOR_RESET_INTERVAL == 0)
+        {
+            previous_rotation = glm::ivec3(0);
+        }
+
+        glm::ivec3 rotation(0);
+
+        if (setup.has_rotation)
+        {
+            const auto offset = read<dvdb::code_points::rotation_offset>(diff_current_ptr);
+            rotation = glm::ivec3(offset.x, offset.y, offset.z);
+
+            if (delta_rotations)
+            {
+                rotation = glm::ivec3(dvdb::code_points::wrap_rotation(rotation.x + previous_rotation.x), dvdb::code_points::wrap_rotation(rotation.y + previous_rotation.y), dvdb::code_points::wrap_rotation(rotation.z + previous_rotation.z));
+            }
+        }
+
+        previous_rotation = rotation;
+
         auto dst_ptr = dst_accessor.leaf_table_ptr(i + index);
         auto dst_mask_ptr = dst_accessor.leaf_bitmask_ptr(i + index);
 
         dvdb::cube_888_f32 dst;
         dvdb::cube_888_mask dst_mask;
 
-        if (setup.has_source && setup.has_rotation)
+        if (setup.has_source && reference == source_e::AVERAGE)
         {
-            const auto source = read<dvdb::code_points::source_key>(diff_current_ptr);
+            src_accessor.leaf_neighbors(source, src_neighbor_values_ptrs, src_neighbor_masks_ptrs, &empty_values, &empty_mask);
+            next_accessor->leaf_neighbors(source, next_neighbor_values_ptrs, next_neighbor_masks_ptrs, &empty_values, &empty_mask);
 
-            const auto [x, y, z] = read<dvdb::code_points::rotation_offset>(diff_current_ptr);
+            // Same neighbourhood as encoder built, without rotation only the center is needed
+            for (int n = 0; n < 27; ++n)
+            {
+                if (setup.has_rotation || n == 13)
+                {
+                    dvdb::average(src_neighbor_values_ptrs[n], next_neighbor_values_ptrs[n], &average_values[n]);
+                    average_masks[n].values = src_neighbor_masks_ptrs[n]->values | next_neighbor_masks_ptrs[n]->values;
+                }
 
-            src_accessor.leaf_neighbors(source, src_neighbor_values_ptrs, src_neighbor_masks_ptrs, &empty_values, &empty_mask);
+                src_neighbor_values_ptrs[n] = &average_values[n];
+                src_neighbor_masks_ptrs[n] = &average_masks[n];
+            }
 
-            dvdb::rotate_refill(&dst, src_neighbor_values_ptrs, x, y, z);
+            if (setup.has_rotation)
+            {
+                dvdb::rotate_refill(&dst, src_neighbor_values_ptrs, rotation.x, rotation.y, rotation.z);
+                dvdb::rotate_refill(&dst_mask, src_neighbor_masks_ptrs, rotation.x, rotation.y, rotation.z);
+            }
+            else
+            {
+                dst = average_values[13];
+                dst_mask = average_masks[13];
+            }
+        }
+        else if (setup.has_source && setup.has_rotation)
+        {
+            accessor.leaf_neighbors(source, src_neighbor_values_ptrs, src_neighbor_masks_ptrs, &empty_values, &empty_mask);
+
+            dvdb::rotate_refill(&dst, src_neighbor_values_ptrs, rotation.x, rotation.y, rotation.z);
 
-            if (!setup.has_fma_and_new_mask)
+            if (needs_source_mask)
             {
-                dvdb::rotate_refill(&dst_mask, src_neighbor_masks_ptrs, x, y, z);
+                dvdb::rotate_refill(&dst_mask, src_neighbor_masks_ptrs, rotation.x, rotation.y, rotation.z);
             }
         }
         else if (setup.has_source)
         {
-            const auto source = read<dvdb::code_points::source_key>(diff_current_ptr);
-            const auto index = src_accessor.get_leaf_index_from_key(source);
+            const auto index = accessor.get_leaf_index_from_key(source);
 
             if (index == -1)
             {
@@ -197,12 +374,20 @@ void grid_reconstruction_worker(int index, void *diff_ptr, int bundle_size, cons
             }
             else
             {
-                const auto src = src_accessor.leaf_table_ptr(index);
-                const auto src_mask = src_accessor.leaf_bitmask_ptr(index);
+                const auto src = accessor.leaf_table_ptr(index);
+                const auto src_mask = accessor.leaf_bitmask_ptr(index);
+
+                // Unchanged leaf, copy straight to destination
+                if (!setup.has_fma_and_new_mask && !setup.has_values)
+                {
+                    *dst_ptr = *src;
+                    *dst_mask_ptr = *src_mask;
+                    continue;
+                }
 
                 dst = *src;
 
-                if (!setup.has_fma_and_new_mask)
+                if (needs_source_mask)
                 {
                     dst_mask = *src_mask;
                 }
@@ -212,7 +397,7 @@ void grid_reconstruction_worker(int index, void *diff_ptr, int bundle_size, cons
         {
             dst = {};
 
-            if (!setup.has_fma_and_new_mask)
+            if (needs_source_mask)
             {
                 dst_mask = {};
             }
@@ -223,7 +408,15 @@ void grid_reconstruction_worker(int index, void *diff_ptr, int bundle_size, cons
             const auto [add, mul] = dvdb::code_points::fma::to_float(read<dvdb::code_points::fma>(diff_current_ptr));
             dvdb::fma(&dst, &dst, add, mul);
 
-            dst_mask = read<dvdb::cube_888_mask>(diff_current_ptr);
+            if (predicted_masks)
+            {
+                const auto predicted_mask = dst_mask;
+                diff_current_ptr += dvdb::decode_mask(diff_current_ptr, &predicted_mask, &dst_mask);
+            }
+            else
+            {
+                dst_mask = read<dvdb::cube_888_mask>(diff_current_ptr);
+            }
         }
 
         *dst_ptr = dst;
@@ -262,6 +455,7 @@ void grid_reconstruction_worker(int index, void *diff_ptr, int bundle_size, cons
 
         if (setup.has_dct)
         {
+            dvdb::dct_snap_to_zero(&encoder_float_values, (max - min) / quantization);
             dvdb::dct_3d_decode(&encoder_float_values, &values);
         }
         else
@@ -282,98 +476,358 @@ void grid_reconstruction_worker(int index, void *diff_ptr, int bundle_size, cons
     }
 }
 
-int get_one_diff_size(void *ptr)
+int get_next_bundle_size(void *ptr, int bundle_size, const dvdb::headers::main &header)
 {
-    auto *moving_ptr = reinterpret_cast<uint8_t *>(ptr);
-    int size = sizeof(dvdb::code_points::setup);
+    int size = 0;
 
-    const auto setup = read<dvdb::code_points::setup>(moving_ptr);
+    for (int i = 0; i < bundle_size; ++i)
+    {
+        const int next_size = static_cast<int>(dvdb::leaf_record_size(ptr, header));
+        size += next_size;
+        ptr = static_cast<char *>(ptr) + next_size;
+    }
+
+    return size;
+}
+
+// Bundle offsets come from the file's bundle index, without one records are walked to find where bundles start
+void grid_reconstruction(void *diff_ptr, void *dst_ptr, std::span<void *const> src_ptrs, std::span<const uint64_t> bundle_offsets, const dvdb::headers::main &header, utils::thread_pool *thread_pool)
+{
+    converter::nvdb_reader dst_accessor;
+    std::vector<converter::nvdb_reader> src_accessors(src_ptrs.size());
+
+    dst_accessor.initialize(dst_ptr);
 
-    if (setup.has_source)
+    for (size_t i = 0; i < src_ptrs.size(); ++i)
     {
-        size += sizeof(dvdb::code_points::source_key);
+        src_accessors[i].initialize(src_ptrs[i]);
     }
 
-    if (setup.has_rotation)
+    const std::span<const converter::nvdb_reader> sources = src_accessors;
+
+    auto *diff_moving_ptr = reinterpret_cast<uint8_t *>(diff_ptr);
+
+    dvdb::cube_888_f32 *src_neighbor_values_ptrs[27];
+    dvdb::cube_888_mask *src_neighbor_masks_ptrs[27];
+
+    int dst_leaf_count = dst_accessor.leaf_count();
+    int dst_leaf_current = 0;
+    static constexpr int RESET_INTERVAL = dvdb::PREDICTOR_RESET_INTERVAL;
+
+    const bool indexed = header.flags & dvdb::headers::main::BUNDLE_INDEX;
+
+    if (indexed && bundle_offsets.size() != (dst_leaf_count + RESET_INTERVAL - 1) / RESET_INTERVAL)
     {
-        size += sizeof(dvdb::code_points::rotation_offset);
+        throw std::runtime_error("Bundle index doesn't match leaf count!");
     }
 
-    if (setup.has_fma_and_new_mask)
+    // Indexed bundles cost nothing to find, many small ones let the pool balance uneven leaves
+    static constexpr int TASKS_PER_WORKER = 16;
+    const int task_count = indexed ? thread_pool->worker_count() * TASKS_PER_WORKER : thread_pool->worker_count();
+
+    int expected_bundle_size = dst_leaf_count / task_count;
+    expected_bundle_size = std::max(1, (expected_bundle_size + RESET_INTERVAL - 1) / RESET_INTERVAL) * RESET_INTERVAL;
+
+    std::vector<std::future<void>> signals;
+    signals.reserve(dst_leaf_count / expected_bundle_size + 1);
+
+    while (dst_leaf_current < dst_leaf_count)
     {
-        size += sizeof(dvdb::code_points::fma) + sizeof(dvdb::cube_888_mask);
+        const auto bundle_size = std::min(expected_bundle_size, dst_leaf_count - dst_leaf_current);
+
+        if (indexed)
+        {
+            diff_moving_ptr = reinterpret_cast<uint8_t *>(diff_ptr) + bundle_offsets[dst_leaf_current / RESET_INTERVAL];
+        }
+
+        signals.emplace_back(thread_pool->enqueue([=, &header]() {
+            grid_reconstruction_worker(dst_leaf_current, diff_moving_ptr, bundle_size, header, dst_accessor, sources);
+        }));
+
+        dst_leaf_current += bundle_size;
+
+        if (!indexed && dst_leaf_current < dst_leaf_count)
+        {
+            diff_moving_ptr = diff_moving_ptr + get_next_bundle_size(diff_moving_ptr, bundle_size, header);
+        }
     }
 
-    if (setup.has_values)
+    thread_pool->work_together();
+
+    for (auto &signal : signals)
     {
-        size += sizeof(dvdb::code_points::quantization) + sizeof(dvdb::cube_888_i8);
+        signal.get();
     }
+}
+
+// Grids of reconstructed state follow each other without gaps
+glm::uvec4 state_grid_offsets(const dvdb::headers::main *header)
+{
+    glm::uvec4 offsets(~0);
 
-    if (setup.has_map)
+    offsets[0] = header->frames[0].base_tree_offset_start;
+
+    for (size_t i = 1; i < header->vdb_grid_count; ++i)
     {
-        size += sizeof(dvdb::code_points::map);
+        offsets[i] = offsets[i - 1] + header->frames[i - 1].base_tree_final_size;
     }
 
-    return size;
+    return offsets;
 }
 
-int get_next_bundle_size(void *ptr, int bundle_size)
+// Rebuilds diff frame into dst from given source states, see grid_reconstruction_worker for their order
+void diff_reconstruction(const std::vector<char> &source_buffer, std::vector<char> &dst, std::span<const std::vector<char> *const> sources, utils::thread_pool *thread_pool)
 {
-    int size = 0;
+    const auto header = reinterpret_cast<const dvdb::headers::main *>(source_buffer.data());
+    const auto offsets = state_grid_offsets(header);
 
-    for (int i = 0; i < bundle_size; ++i)
+    if (dst.size() < header->vdb_required_size)
     {
-        int next_size = get_one_diff_size(ptr);
-        size += next_size;
-        ptr = static_cast<char *>(ptr) + next_size;
+        dst.resize(header->vdb_required_size);
     }
 
-    return size;
+    std::memcpy(dst.data(), source_buffer.data(), sizeof(*header));
+
+    for (size_t i = 0; i < header->vdb_grid_count; ++i)
+    {
+        std::memcpy(dst.data() + offsets[i], source_buffer.data() + header->frames[i].base_tree_offset_start, header->frames[i].base_tree_copy_size);
+    }
+
+    std::vector<glm::uvec4> src_offsets;
+
+    for (const auto source : sources)
+    {
+        src_offsets.push_back(state_grid_offsets(reinterpret_cast<const dvdb::headers::main *>(source->data())));
+    }
+
+    std::vector<void *> src_grids(sources.size());
+
+    // Bundle indices of all grids follow the last base tree
+    const auto &last_base = header->frames[std::max<uint64_t>(header->vdb_grid_count, 1) - 1];
+    const char *index_ptr = source_buffer.data() + last_base.base_tree_offset_start + last_base.base_tree_copy_size;
+    std::vector<uint64_t> bundle_offsets;
+
+    for (size_t i = 0; i < header->vdb_grid_count; ++i)
+    {
+        if (header->flags & dvdb::headers::main::BUNDLE_INDEX)
+        {
+            dvdb::headers::bundle_index index;
+            std::memcpy(&index, index_ptr, sizeof(index));
+            index_ptr += sizeof(index);
+
+            if (index_ptr + index.bundle_count * sizeof(uint64_t) > source_buffer.data() + header->frames[0].diff_data_offset_start)
+            {
+                throw std::runtime_error("Bundle index crosses into diff data!");
+            }
+
+            bundle_offsets.resize(index.bundle_count);
+            std::memcpy(bundle_offsets.data(), index_ptr, index.bundle_count * sizeof(uint64_t));
+            index_ptr += index.bundle_count * sizeof(uint64_t);
+        }
+
+        for (size_t s = 0; s < sources.size(); ++s)
+        {
+            src_grids[s] = const_cast<char *>(sources[s]->data()) + src_offsets[s][i];
+        }
+
+        void *dst_grid = dst.data() + offsets[i];
+        // removing constness is ok here
+        void *diff_data = const_cast<char *>(source_buffer.data()) + header->frames[i].diff_data_offset_start;
+
+        grid_reconstruction(diff_data, dst_grid, src_grids, bundle_offsets, *header, thread_pool);
+    }
 }
 
-void grid_reconstruction(void *diff_ptr, void *dst_ptr, void *src_ptr, utils::thread_pool *thread_pool)
+size_t diff_vdb_resource::frame_count() const
 {
-    converter::nvdb_reader dst_accessor, src_accessor;
+    return _container ? _container->frame_count() : _dvdb_frames.size();
+}
 
-    dst_accessor.initialize(dst_ptr);
-    src_accessor.initialize(src_ptr);
+utils::read_ahead::request diff_vdb_resource::frame_request(size_t frame_number) const
+{
+    if (_container)
+    {
+        return {
+            .size = _container->frame(frame_number).size,
+            .mapped = _container->frame_data(frame_number),
+        };
+    }
 
-    auto *diff_moving_ptr = reinterpret_cast<uint8_t *>(diff_ptr);
+    return {.path = _dvdb_frames[frame_number].second.string()};
+}
 
-    dvdb::cube_888_f32 *src_neighbor_values_ptrs[27];
-    dvdb::cube_888_mask *src_neighbor_masks_ptrs[27];
+void diff_vdb_resource::read_ahead_after(size_t frame_number)
+{
+    const auto window = _read_ahead->window(get_frame_rate());
+    std::vector<std::pair<size_t, utils::read_ahead::request>> frames;
 
-    int dst_leaf_count = dst_accessor.leaf_count();
-    int dst_leaf_current = 0;
-    int expected_bundle_size = dst_leaf_count / thread_pool->worker_count();
+    // Starts with the frame about to be decoded, its read might be done already. Playback wraps around to the first frame.
+    for (size_t i = 0; i <= window && i < frame_count(); ++i)
+    {
+        const auto n = (frame_number + i) % frame_count();
+        frames.emplace_back(n, frame_request(n));
+    }
 
-    std::vector<std::future<void>> signals;
-    signals.reserve(thread_pool->worker_count() + 1);
+    _read_ahead->prefetch(frames);
+}
+
+size_t diff_vdb_resource::load_frame(size_t frame_number, std::vector<char> &source_buffer, utils::thread_pool *thread_pool) const
+{
+    auto packed = _read_ahead->take(frame_number, frame_request(frame_number));
+    const auto packed_size = packed.size();
+
+    converter::unpack_dvdb_data(packed.data(), packed.size(), source_buffer, thread_pool);
+    _read_ahead->recycle(std::move(packed));
+
+    const auto header = reinterpret_cast<const dvdb::headers::main *>(source_buffer.data());
 
-    while (dst_leaf_current + expected_bundle_size < dst_leaf_count)
+    if (header->magic != dvdb::MAGIC_NUMBER)
     {
-        const auto next_bundle_size = get_next_bundle_size(diff_moving_ptr, expected_bundle_size);
+        throw std::runtime_error("DiffVDB magic number failed");
+    }
 
-        signals.emplace_back(thread_pool->enqueue([=]() {
-            grid_reconstruction_worker(dst_leaf_current, diff_moving_ptr, expected_bundle_size, dst_accessor, src_accessor);
-        }));
+    return packed_size;
+}
+
+void diff_vdb_resource::promote_to_current(std::vector<char> &state)
+{
+    // Oldest state is dropped and its buffer handed back for reuse
+    std::rotate(_previous_states.rbegin(), _previous_states.rbegin() + 1, _previous_states.rend());
+    std::swap(_previous_states.front(), _current_state);
+    std::swap(_current_state, state);
+}
+
+std::vector<const std::vector<char> *> diff_vdb_resource::anchor_sources() const
+{
+    std::vector<const std::vector<char> *> sources{&_current_state};
 
-        dst_leaf_current += expected_bundle_size;
-        diff_moving_ptr = diff_moving_ptr + next_bundle_size;
+    for (const auto &state : _previous_states)
+    {
+        if (state.empty())
+        {
+            break;
+        }
+
+        sources.push_back(&state);
     }
 
-    if (dst_leaf_current < dst_leaf_count)
+    return sources;
+}
+
+void diff_vdb_resource::decode_next_anchor(int frame_number, utils::thread_pool *thread_pool)
+{
+    for (size_t n = frame_number + 1; n < frame_count(); ++n)
     {
-        signals.emplace_back(thread_pool->enqueue([=]() {
-            grid_reconstruction_worker(dst_leaf_current, diff_moving_ptr, dst_leaf_count - dst_leaf_current, dst_accessor, src_accessor);
-        }));
+        // Frame being decoded still occupies _frame_buffer
+        auto &source_buffer = _anchor_frame_buffer;
+        _next_anchor_packed_size = load_frame(n, source_buffer, thread_pool);
+        const auto header = reinterpret_cast<const dvdb::headers::main *>(source_buffer.data());
+
+        switch (header->frame_type)
+        {
+        case dvdb::headers::main::frame_type_e::KEY_FRAME:
+            std::swap(_next_anchor_state, source_buffer);
+            break;
+        case dvdb::headers::main::frame_type_e::DIFF_FRAME:
+        case dvdb::headers::main::frame_type_e::MULTI_REFERENCE_FRAME:
+            diff_reconstruction(source_buffer, _next_anchor_state, anchor_sources(), thread_pool);
+            break;
+        case dvdb::headers::main::frame_type_e::BIDIRECTIONAL_FRAME:
+            continue;
+        default:
+            throw std::runtime_error("Invalid frame type! Corrupted data?");
+        }
+
+        _next_anchor_frame = static_cast<int>(n);
+        return;
     }
 
-    thread_pool->work_together();
+    throw std::runtime_error("Bidirectional frame has no following anchor frame!");
+}
 
-    for (auto &signal : signals)
+size_t diff_vdb_resource::keyframe_of(size_t frame_number) const
+{
+    return _keyframes[frame_number];
+}
+
+void diff_vdb_resource::prepare_seek(size_t frame_number)
+{
+    std::lock_guard lock(_state_modification_mtx);
+    _seek_target = static_cast<int>(frame_number);
+}
+
+void diff_vdb_resource::decode_anchors_before(size_t frame_number, utils::thread_pool *thread_pool)
+{
+    const auto keyframe = keyframe_of(frame_number);
+
+    // Nearest checkpoint of the same GOP, frames after a key frame never reference ones before it
+    const checkpoint *start = nullptr;
+
+    for (const auto &checkpoint : _checkpoints)
     {
-        signal.get();
+        if (checkpoint.frame >= keyframe && checkpoint.frame < frame_number && (!start || checkpoint.frame > start->frame))
+        {
+            start = &checkpoint;
+        }
+    }
+
+    size_t n = keyframe;
+
+    if (start)
+    {
+        _current_state = start->current_state;
+        _previous_states = start->previous_states;
+        n = start->frame + 1;
+    }
+    else
+    {
+        _current_state.clear();
+
+        for (auto &state : _previous_states)
+        {
+            state.clear();
+        }
+    }
+
+    _created_is_anchor = false;
+    _next_anchor_frame = -1;
+
+    for (; n < frame_number; ++n)
+    {
+        auto &source_buffer = _frame_buffer;
+        load_frame(n, source_buffer, thread_pool);
+        const auto header = reinterpret_cast<const dvdb::headers::main *>(source_buffer.data());
+
+        switch (header->frame_type)
+        {
+        case dvdb::headers::main::frame_type_e::KEY_FRAME:
+            promote_to_current(source_buffer);
+            break;
+        case dvdb::headers::main::frame_type_e::DIFF_FRAME:
+        case dvdb::headers::main::frame_type_e::MULTI_REFERENCE_FRAME:
+            diff_reconstruction(source_buffer, _created_state, anchor_sources(), thread_pool);
+            promote_to_current(_created_state);
+            break;
+        case dvdb::headers::main::frame_type_e::BIDIRECTIONAL_FRAME:
+            continue;
+        default:
+            throw std::runtime_error("Invalid frame type! Corrupted data?");
+        }
+
+        // Key frames decode alone, only states further into the GOP are worth keeping
+        if (n != keyframe && (n - keyframe) % CHECKPOINT_INTERVAL == 0 && std::none_of(_checkpoints.begin(), _checkpoints.end(), [n](const checkpoint &c) { return c.frame == n; }))
+        {
+            if (_checkpoints.size() == MAX_CHECKPOINTS)
+            {
+                _checkpoints.pop_front();
+            }
+
+            _checkpoints.push_back({
+                .frame = n,
+                .current_state = _current_state,
+                .previous_states = _previous_states,
+            });
+        }
     }
 }
 
@@ -388,11 +842,6 @@ void diff_vdb_resource::schedule_frame(scene::object_context &ctx, int block_num
     _ssbo_block_frame[block_number] = frame_number;
     _ssbo_timestamp[block_number] = std::chrono::steady_clock::now();
 
-    { // lock to make sure workers finished their previous workload
-        std::lock_guard lock(_state_modification_mtx);
-        std::swap(_created_state, _current_state);
-    }
-
     std::atomic_bool worker_side_locked = false;
 
     std::function task = [this, wptr = weak_from_this(), frame_number, block_number, &worker_side_locked, wtp = std::weak_ptr(ctx.generic_thread_pool_sptr()), wait_t1, wait_t2]() -> update_range {
@@ -410,17 +859,37 @@ void diff_vdb_resource::schedule_frame(scene::object_context &ctx, int block_num
         std::lock_guard lock(_state_modification_mtx);
         worker_side_locked = true;
 
+        // After a seek anchors before the target are rebuilt here, on the pool like any other decoding
+        if (_seek_target == frame_number)
+        {
+            _seek_target = -1;
+            decode_anchors_before(frame_number, thread_pool.get());
+        }
+
+        // Anchor decoded last time becomes the source, bidirectional frames never do
+        if (_created_is_anchor)
+        {
+            promote_to_current(_created_state);
+            _created_is_anchor = false;
+        }
+
+        read_ahead_after(frame_number);
+
+        // Anchor might have been decoded ahead of frames predicted from it
+        const bool anchor_ready = frame_number == _next_anchor_frame;
+
         auto map_t1 = std::chrono::steady_clock::now();
-        const auto str8 = _dvdb_frames[frame_number].second.string();
-        const auto source_buffer = converter::unpack_dvdb_file(str8.c_str());
 
-        const auto header = reinterpret_cast<const dvdb::headers::main *>(source_buffer.data());
+        const auto &source_buffer = _frame_buffer;
+        size_t compressed_size = anchor_ready ? _next_anchor_packed_size : 0;
 
-        if (header->magic != dvdb::MAGIC_NUMBER)
+        if (!anchor_ready)
         {
-            throw std::runtime_error("DiffVDB magic number failed");
+            compressed_size = load_frame(frame_number, _frame_buffer, thread_pool.get());
         }
 
+        const auto header = reinterpret_cast<const dvdb::headers::main *>(anchor_ready ? _next_anchor_state.data() : source_buffer.data());
+
         copy_size = header->vdb_required_size;
         auto map_t2 = std::chrono::steady_clock::now();
 
@@ -428,75 +897,90 @@ void diff_vdb_resource::schedule_frame(scene::object_context &ctx, int block_num
 
         auto copy_t1 = std::chrono::steady_clock::now();
 
-        size_t compressed_size = 0;
         size_t data_size = 0;
 
-        switch (header->frame_type)
-        {
-        case dvdb::headers::main::frame_type_e::KEY_FRAME: {
-            for (size_t i = 0; i < header->vdb_grid_count; ++i)
-            {
-                offsets[i] = header->frames[i].base_tree_offset_start;
+        const auto source_data_size = [this]() {
+            const auto src_header = reinterpret_cast<const dvdb::headers::main *>(_current_state.data());
+            size_t size = src_header->frames[0].base_tree_offset_start;
 
-                if (offsets[i] % 16 != 0)
-                {
-                    throw std::runtime_error("Bad alignment");
-                }
+            for (const auto &frame : src_header->frames)
+            {
+                size += frame.base_tree_final_size;
             }
 
-            _created_state = std::move(source_buffer);
-            utils::gpu_memcpy(_ssbo_ptr + block_number * _ssbo_block_size, _created_state.data(), _created_state.size());
-            data_size = _created_state.size();
-        }
-        break;
-        case dvdb::headers::main::frame_type_e::DIFF_FRAME: {
-            offsets[0] = header->frames[0].base_tree_offset_start;
+            return size;
+        };
 
-            for (size_t i = 1; i < header->vdb_grid_count; ++i)
-            {
-                offsets[i] = offsets[i - 1] + header->frames[i - 1].base_tree_final_size;
-            }
+        if (anchor_ready)
+        {
+            promote_to_current(_next_anchor_state);
+            _next_anchor_frame = -1;
 
-            std::memcpy(_created_state.data(), source_buffer.data(), sizeof(*header));
+            offsets = state_grid_offsets(reinterpret_cast<const dvdb::headers::main *>(_current_state.data()));
+            data_size = copy_size;
 
-            for (size_t i = 0; i < header->vdb_grid_count; ++i)
+            utils::gpu_memcpy(_ssbo_ptr + block_number * _ssbo_block_size, _current_state.data(), copy_size);
+        }
+        else
+        {
+            switch (header->frame_type)
             {
-                std::memcpy(_created_state.data() + offsets[i], source_buffer.data() + header->frames[i].base_tree_offset_start, header->frames[i].base_tree_copy_size);
-            }
+            case dvdb::headers::main::frame_type_e::KEY_FRAME: {
+                for (size_t i = 0; i < header->vdb_grid_count; ++i)
+                {
+                    offsets[i] = header->frames[i].base_tree_offset_start;
 
-            const auto src_header = reinterpret_cast<const dvdb::headers::main *>(_current_state.data());
+                    if (offsets[i] % 16 != 0)
+                    {
+                        throw std::runtime_error("Bad alignment");
+                    }
+                }
 
-            uint64_t src_offsets[4];
+                // Unpacked frame is the state itself, buffers trade places so the old one gets reused
+                std::swap(_created_state, _frame_buffer);
+                _created_is_anchor = true;
+                _next_anchor_frame = -1;
 
-            src_offsets[0] = src_header->frames[0].base_tree_offset_start;
-            src_offsets[1] = src_offsets[0] + src_header->frames[0].base_tree_final_size;
-            src_offsets[2] = src_offsets[1] + src_header->frames[1].base_tree_final_size;
-            src_offsets[3] = src_offsets[2] + src_header->frames[2].base_tree_final_size;
+                utils::gpu_memcpy(_ssbo_ptr + block_number * _ssbo_block_size, _created_state.data(), _created_state.size());
+                data_size = _created_state.size();
+            }
+            break;
+            case dvdb::headers::main::frame_type_e::DIFF_FRAME:
+            case dvdb::headers::main::frame_type_e::MULTI_REFERENCE_FRAME: {
+                offsets = state_grid_offsets(header);
+                data_size = source_data_size();
 
-            for (size_t i = 0; i < header->vdb_grid_count; ++i)
-            {
-                void *src_grid = _current_state.data() + src_offsets[i];
-                void *dst_grid = _created_state.data() + offsets[i];
-                // removing constness is ok here
-                void *diff_data = const_cast<char *>(source_buffer.data()) + header->frames[i].diff_data_offset_start;
+                diff_reconstruction(source_buffer, _created_state, anchor_sources(), thread_pool.get());
+                _created_is_anchor = true;
+                _next_anchor_frame = -1;
 
-                grid_reconstruction(diff_data, dst_grid, src_grid, thread_pool.get());
+                utils::gpu_memcpy(_ssbo_ptr + block_number * _ssbo_block_size, _created_state.data(), header->vdb_required_size);
             }
+            break;
+            case dvdb::headers::main::frame_type_e::BIDIRECTIONAL_FRAME: {
+                if (_next_anchor_frame <= frame_number)
+                {
+                    decode_next_anchor(frame_number, thread_pool.get());
+                }
 
-            data_size = src_offsets[3] + src_header->frames[3].base_tree_final_size;
+                offsets = state_grid_offsets(header);
+                data_size = source_data_size();
 
-            utils::gpu_memcpy(_ssbo_ptr + block_number * _ssbo_block_size, _created_state.data(), header->vdb_required_size);
-        }
-        break;
-        default:
-            throw std::runtime_error("Invalid frame type! Corrupted data?");
+                const std::vector<char> *sources[] = {&_current_state, &_next_anchor_state};
+                diff_reconstruction(source_buffer, _created_state, sources, thread_pool.get());
+
+                utils::gpu_memcpy(_ssbo_ptr + block_number * _ssbo_block_size, _created_state.data(), header->vdb_required_size);
+            }
+            break;
+            default:
+                throw std::runtime_error("Invalid frame type! Corrupted data?");
+            }
         }
 
         auto copy_t2 = std::chrono::steady_clock::now();
 
         utils::update_copy_time(std::chrono::duration_cast<std::chrono::microseconds>(copy_t2 - copy_t1).count());
-
-        compressed_size = _dvdb_frames[frame_number].second.string().size();
+        _read_ahead->update_decode_time(std::chrono::duration<double>(copy_t2 - map_t1).count());
 
         _csv_out << frame_number << ';'
                  << compressed_size << ';'
@@ -2,6 +2,21 @@
 
 #include "volume_resource_base.hpp"
 
+#include <dvdb/types.hpp>
+#include <utils/read_ahead.hpp>
+
+#include <deque>
+
+namespace converter
+{
+class dvdb_container;
+}
+
+namespace utils
+{
+class thread_pool;
+}
+
 namespace objects::vdb
 {
 class diff_vdb_resource : public volume_resource_base
@@ -22,9 +37,62 @@ private:
     std::filesystem::path _resource_directory;
     std::vector<std::pair<int, std::filesystem::path>> _dvdb_frames;
 
+    // Set when animation is a single .dvdbs file, _dvdb_frames stay empty then
+    std::unique_ptr<converter::dvdb_container> _container;
+
+    // Compressed frames are read ahead of the playhead, load_frame takes them from here
+    std::unique_ptr<utils::read_ahead> _read_ahead;
+    void read_ahead_after(size_t frame_number);
+    utils::read_ahead::request frame_request(size_t frame_number) const;
+
+    size_t frame_count() const;
+    size_t load_frame(size_t frame_number, std::vector<char> &source_buffer, utils::thread_pool *) const; // Returns packed size
+
+    // Unpacked frames, kept between frames so their memory is reused. Key frames swap theirs with the state.
+    std::vector<char> _frame_buffer;
+    std::vector<char> _anchor_frame_buffer;
+
     std::mutex _state_modification_mtx;
 
     std::vector<char> _current_state;
     std::vector<char> _created_state;
+    bool _created_is_anchor = false;
+
+    // Anchors before the current one, most recent first, for multi reference frames
+    std::array<std::vector<char>, dvdb::MAX_REFERENCE_FRAMES - 1> _previous_states;
+
+    void promote_to_current(std::vector<char> &);
+    std::vector<const std::vector<char> *> anchor_sources() const;
+
+    // Bidirectional frames need the anchor after them, it's decoded ahead and kept until its turn
+    std::vector<char> _next_anchor_state;
+    int _next_anchor_frame = -1;
+    size_t _next_anchor_packed_size = 0;
+
+    void decode_next_anchor(int frame_number, utils::thread_pool *);
+
+    void prepare_seek(size_t frame_number) override;
+
+    // Index of key frame every frame can be decoded from, read from container index or frame headers in init
+    std::vector<uint32_t> _keyframes;
+    size_t keyframe_of(size_t frame_number) const;
+
+    // Decoder state right after an anchor was decoded during a seek, lets later seeks skip part of the GOP
+    struct checkpoint
+    {
+        size_t frame;
+        std::vector<char> current_state;
+        std::array<std::vector<char>, dvdb::MAX_REFERENCE_FRAMES - 1> previous_states;
+    };
+
+    static constexpr size_t CHECKPOINT_INTERVAL = 8;
+    static constexpr size_t MAX_CHECKPOINTS = 4;
+
+    std::deque<checkpoint> _checkpoints;
+
+    // Frame whose anchors are decoded by the task scheduling it, negative when not seeking
+    int _seek_target = -1;
+
+    void decode_anchors_before(size_t frame_number, utils::thread_pool *);
 };
 } // namespace objects::vdb
@@ -7,6 +7,7 @@
 #include <utils/gpu_memcpy.hpp>
 #include <utils/memory_counter.hpp>
 #include <utils/nvdb_mmap.hpp>
+#include <utils/read_ahead.hpp>
 #include <utils/thread_pool.hpp>
 #include <utils/utf8_exception.hpp>
 
@@ -29,6 +30,7 @@ void nano_vdb_resource::on_destroy(scene::object_context &ctx)
 
 nano_vdb_resource::nano_vdb_resource(std::filesystem::path path)
     : _resource_directory(path)
+    , _read_ahead(std::make_unique<utils::read_ahead>())
 {
     std::vector<std::pair<int, std::filesystem::path>> nvdb_files;
 
@@ -108,6 +110,11 @@ void nano_vdb_resource::init(scene::object_context &ctx)
     _ssbo_block_size = max_buffer_size;
     _ssbo_block_count = MAX_BLOCKS;
 
+    for (auto &buffer : _staging_buffers)
+    {
+        buffer.reset(new char[_ssbo_block_size]);
+    }
+
     utils::gpu_buffer_memory_allocated(_ssbo_block_size * _ssbo_block_count);
 
     glNamedBufferStorage(_ssbo, _ssbo_block_size * _ssbo_block_count, 0, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT);
@@ -120,6 +127,21 @@ void nano_vdb_resource::init(scene::object_context &ctx)
     }
 }
 
+void nano_vdb_resource::read_ahead_after(size_t frame_number)
+{
+    const auto window = _read_ahead->window(get_frame_rate());
+    std::vector<std::pair<size_t, utils::read_ahead::request>> frames;
+
+    // Starts with the frame about to be decoded, its read might be done already. Playback wraps around to the first frame.
+    for (size_t i = 0; i <= window && i < _nvdb_frames.size(); ++i)
+    {
+        const auto n = (frame_number + i) % _nvdb_frames.size();
+        frames.emplace_back(n, utils::read_ahead::request{.path = _nvdb_frames[n].second.string()});
+    }
+
+    _read_ahead->prefetch(frames);
+}
+
 void nano_vdb_resource::schedule_frame(scene::object_context &ctx, int block_number, int frame_number)
 {
     auto wait_t1 = std::chrono::steady_clock::now();
@@ -131,6 +153,9 @@ void nano_vdb_resource::schedule_frame(scene::object_context &ctx, int block_num
     _ssbo_block_frame[block_number] = frame_number;
     _ssbo_timestamp[block_number] = std::chrono::steady_clock::now();
 
+    // Blocks decode in parallel, windows refreshed by the others must not drop this frame before it's taken
+    _read_ahead->claim(frame_number, {.path = _nvdb_frames[frame_number].second.string()});
+
     std::function task = [this, wptr = weak_from_this(), block_number, frame_number, wait_t1, wait_t2]() -> update_range {
         glm::uvec4 offsets(~0);
         size_t copy_size = 0;
@@ -142,11 +167,15 @@ void nano_vdb_resource::schedule_frame(scene::object_context &ctx, int block_num
             return {};
         }
 
+        read_ahead_after(frame_number);
+
         auto map_t1 = std::chrono::steady_clock::now();
 
-        std::vector<char> mid_buffer(_ssbo_block_size);
-        const auto str8 = _nvdb_frames[frame_number].second.string();
-        offsets = converter::unpack_nvdb_file(str8.c_str(), mid_buffer.data(), _ssbo_block_size, &copy_size);
+        auto packed = _read_ahead->take(frame_number, {.path = _nvdb_frames[frame_number].second.string()});
+
+        // Block is rescheduled only after its previous frame was shown, nothing else uses its staging buffer now
+        const auto staging_buffer = _staging_buffers[block_number].get();
+        offsets = converter::unpack_nvdb_data(packed.data(), packed.size(), staging_buffer, _ssbo_block_size, &copy_size);
 
         auto map_t2 = std::chrono::steady_clock::now();
 
@@ -154,13 +183,15 @@ void nano_vdb_resource::schedule_frame(scene::object_context &ctx, int block_num
 
         auto copy_t1 = std::chrono::steady_clock::now();
 
-        utils::gpu_memcpy(_ssbo_ptr + _ssbo_block_size * block_number, mid_buffer.data(), copy_size);
+        utils::gpu_memcpy(_ssbo_ptr + _ssbo_block_size * block_number, staging_buffer, copy_size);
 
         auto copy_t2 = std::chrono::steady_clock::now();
 
         utils::update_copy_time(std::chrono::duration_cast<std::chrono::microseconds>(copy_t2 - copy_t1).count());
+        _read_ahead->update_decode_time(std::chrono::duration<double>(copy_t2 - map_t1).count());
 
-        size_t compressed_size = mio::mmap_source(_nvdb_frames[frame_number].second.string()).size();
+        size_t compressed_size = packed.size();
+        _read_ahead->recycle(std::move(packed));
         size_t data_size = copy_size;
 
         _csv_out << frame_number << ';'
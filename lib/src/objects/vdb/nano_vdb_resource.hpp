@@ -2,6 +2,10 @@
 
 #include "volume_resource_base.hpp"
 
+#include <utils/read_ahead.hpp>
+
+#include <memory>
+
 namespace objects::vdb
 {
 class nano_vdb_resource : public volume_resource_base
@@ -20,5 +24,13 @@ public:
 private:
     std::filesystem::path _resource_directory;
     std::vector<std::pair<int, std::filesystem::path>> _nvdb_frames;
+
+    // Decompression target of every block, allocated once. LZ4 reads back what it wrote, which is slow on write-combined
+    // mapped memory, so frames are decompressed here and streamed to the block.
+    std::array<std::unique_ptr<char[]>, MAX_BLOCKS> _staging_buffers;
+
+    // Compressed frames are read ahead of the playhead
+    std::unique_ptr<utils::read_ahead> _read_ahead;
+    void read_ahead_after(size_t frame_number);
 };
 } // namespace objects::vdb
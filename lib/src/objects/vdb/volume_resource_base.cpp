@@ -150,6 +150,44 @@ int volume_resource_base::get_active_block_number()
     return -1;
 }
 
+void volume_resource_base::seek(scene::object_context &ctx, size_t frame_number)
+{
+    if (_frames.empty())
+    {
+        return;
+    }
+
+    frame_number %= _frames.size();
+
+    // Shown block gets overwritten too, GPU may still be reading it. Other blocks were fenced when playback moved past them.
+    if (const int active = get_active_block_number(); active >= 0)
+    {
+        _ssbo_block_fences[active].sync();
+    }
+
+    for (size_t i = 0; i < MAX_BLOCKS; ++i)
+    {
+        if (_ssbo_block_loaded[i].valid())
+        {
+            _ssbo_block_loaded[i].wait();
+        }
+
+        _ssbo_block_loaded[i] = {};
+        _ssbo_block_frame[i] = ~static_cast<size_t>(0);
+    }
+
+    _current_frame = frame_number;
+    _frame_overshoot = 0;
+
+    prepare_seek(frame_number);
+
+    // Same lead as playback keeps, it schedules the next frame whenever one is shown
+    for (size_t i = 0; i + 1 < MAX_BLOCKS; ++i)
+    {
+        schedule_frame(ctx, static_cast<int>(i), static_cast<int>((frame_number + i) % _frames.size()));
+    }
+}
+
 void volume_resource_base::reset_csv_and_sys_cache()
 {
     _csv_out.close();
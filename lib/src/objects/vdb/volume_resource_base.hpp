@@ -43,6 +43,14 @@ public:
         return _current_frame;
     }
 
+    size_t get_frame_count()
+    {
+        return _frames.size();
+    }
+
+    // Jumps to given frame, frames scheduled for the old position are dropped
+    void seek(scene::object_context &, size_t frame_number);
+
     // void set_no_unload(bool);
     // bool get_no_unload();
 
@@ -104,6 +112,11 @@ public:
 protected:
     static constexpr size_t MAX_BLOCKS = 3;
 
+    // Called by seek once nothing is in flight, before target frame gets scheduled
+    virtual void prepare_seek(size_t)
+    {
+    }
+
     struct update_range
     {
         glm::uvec4 offsets;
@@ -0,0 +1,289 @@
+#include "read_ahead.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+namespace utils
+{
+namespace
+{
+static constexpr size_t MIN_WINDOW = 2;
+static constexpr size_t MAX_WINDOW = 32;
+static constexpr size_t MAX_READY_BYTES = size_t(1) << 30; // Read ahead pauses above this much unused data
+static constexpr size_t MAX_FREE_BUFFERS = 8;
+static constexpr double AVERAGE_WEIGHT = 0.1;
+
+void update_average(double &average, double value)
+{
+    average = average == 0 ? value : average + (value - average) * AVERAGE_WEIGHT;
+}
+} // namespace
+
+read_ahead::read_ahead()
+    : _io_thread([this]() { io_loop(); })
+{
+}
+
+read_ahead::~read_ahead()
+{
+    {
+        std::lock_guard lock(_mtx);
+        _stopping = true;
+    }
+
+    _cvar.notify_all();
+    _io_thread.join();
+}
+
+void read_ahead::prefetch(const std::vector<std::pair<size_t, request>> &frames)
+{
+    {
+        std::lock_guard lock(_mtx);
+
+        for (auto it = _entries.begin(); it != _entries.end();)
+        {
+            const bool wanted = std::any_of(frames.begin(), frames.end(), [&](const auto &frame) { return frame.first == it->first; });
+
+            if (wanted || it->second.claimed || it->second.state == state_e::READING)
+            {
+                ++it;
+                continue;
+            }
+
+            if (it->second.state == state_e::READY)
+            {
+                _ready_bytes -= it->second.buffer.size();
+                _free_buffers.push_back(std::move(it->second.buffer));
+            }
+
+            it = _entries.erase(it);
+        }
+
+        for (size_t i = 0; i < frames.size(); ++i)
+        {
+            auto [it, inserted] = _entries.try_emplace(frames[i].first);
+
+            if (inserted)
+            {
+                it->second.source = frames[i].second;
+            }
+
+            // Claimed frames stay ahead of everything listed
+            it->second.order = it->second.claimed ? 0 : i + 1;
+        }
+
+        if (_free_buffers.size() > MAX_FREE_BUFFERS)
+        {
+            _free_buffers.resize(MAX_FREE_BUFFERS);
+        }
+    }
+
+    _cvar.notify_all();
+}
+
+void read_ahead::claim(size_t frame, const request &request)
+{
+    {
+        std::lock_guard lock(_mtx);
+
+        auto [it, inserted] = _entries.try_emplace(frame);
+
+        if (inserted)
+        {
+            it->second.source = request;
+        }
+
+        it->second.claimed = true;
+        it->second.order = 0;
+    }
+
+    _cvar.notify_all();
+}
+
+std::vector<char> read_ahead::take(size_t frame, const request &request)
+{
+    std::unique_lock lock(_mtx);
+
+    auto it = _entries.find(frame);
+
+    // Failed reads are erased, look the entry up again every time
+    _cvar.wait(lock, [&]() {
+        it = _entries.find(frame);
+        return it == _entries.end() || it->second.state != state_e::READING;
+    });
+
+    if (it != _entries.end() && it->second.state == state_e::READY)
+    {
+        auto buffer = std::move(it->second.buffer);
+
+        _ready_bytes -= buffer.size();
+        _entries.erase(it);
+        lock.unlock();
+
+        // Reader may have paused on the byte limit
+        _cvar.notify_all();
+
+        return buffer;
+    }
+
+    // Never got to it, read it here instead of queueing behind frames needed later
+    if (it != _entries.end())
+    {
+        _entries.erase(it);
+    }
+
+    auto buffer = acquire_buffer();
+    lock.unlock();
+
+    read(request, buffer);
+
+    return buffer;
+}
+
+void read_ahead::recycle(std::vector<char> buffer)
+{
+    std::lock_guard lock(_mtx);
+
+    if (_free_buffers.size() < MAX_FREE_BUFFERS)
+    {
+        _free_buffers.push_back(std::move(buffer));
+    }
+}
+
+size_t read_ahead::window(float frame_rate)
+{
+    std::lock_guard lock(_mtx);
+
+    // Frames shown while one frame is read and decoded, plus the one being decoded
+    const auto frames = std::ceil((_read_time + _decode_time) * frame_rate) + 1;
+
+    return std::clamp(static_cast<size_t>(frames), MIN_WINDOW, MAX_WINDOW);
+}
+
+void read_ahead::update_decode_time(double seconds)
+{
+    std::lock_guard lock(_mtx);
+    update_average(_decode_time, seconds);
+}
+
+void read_ahead::read(const request &request, std::vector<char> &buffer)
+{
+    const auto t1 = std::chrono::steady_clock::now();
+
+    if (request.mapped)
+    {
+        // Copying faults the pages in here rather than on the decoding thread
+        buffer.assign(request.mapped + request.offset, request.mapped + request.offset + request.size);
+        const auto t2 = std::chrono::steady_clock::now();
+
+        std::lock_guard lock(_mtx);
+        update_average(_read_time, std::chrono::duration<double>(t2 - t1).count());
+        return;
+    }
+
+    std::ifstream file(request.path, std::ios::binary);
+
+    if (!file)
+    {
+        throw std::runtime_error("Can't open frame for reading: " + request.path);
+    }
+
+    buffer.resize(request.size != 0 ? request.size : std::filesystem::file_size(request.path));
+
+    file.seekg(request.offset);
+    file.read(buffer.data(), buffer.size());
+
+    if (file.gcount() != static_cast<std::streamsize>(buffer.size()))
+    {
+        throw std::runtime_error("Frame ended before its size: " + request.path);
+    }
+
+    const auto t2 = std::chrono::steady_clock::now();
+
+    std::lock_guard lock(_mtx);
+    update_average(_read_time, std::chrono::duration<double>(t2 - t1).count());
+}
+
+// Caller holds the lock
+std::vector<char> read_ahead::acquire_buffer()
+{
+    if (_free_buffers.empty())
+    {
+        return {};
+    }
+
+    auto buffer = std::move(_free_buffers.back());
+    _free_buffers.pop_back();
+
+    return buffer;
+}
+
+void read_ahead::io_loop()
+{
+    std::unique_lock lock(_mtx);
+
+    while (true)
+    {
+        const auto next = [this]() {
+            auto best = _entries.end();
+
+            for (auto it = _entries.begin(); it != _entries.end(); ++it)
+            {
+                if (it->second.state == state_e::QUEUED && (best == _entries.end() || it->second.order < best->second.order))
+                {
+                    best = it;
+                }
+            }
+
+            return best;
+        };
+
+        _cvar.wait(lock, [&]() { return _stopping || (_ready_bytes < MAX_READY_BYTES && next() != _entries.end()); });
+
+        if (_stopping)
+        {
+            return;
+        }
+
+        auto it = next();
+        it->second.state = state_e::READING;
+
+        const auto source = it->second.source;
+        auto buffer = acquire_buffer();
+
+        lock.unlock();
+
+        bool failed = false;
+
+        try
+        {
+            read(source, buffer);
+        }
+        catch (std::exception &)
+        {
+            // Left for take() to read again and report
+            failed = true;
+        }
+
+        lock.lock();
+
+        // Entries being read are never erased by others, iterator stays valid
+        if (failed)
+        {
+            _entries.erase(it);
+        }
+        else
+        {
+            it->second.state = state_e::READY;
+            it->second.buffer = std::move(buffer);
+            _ready_bytes += it->second.buffer.size();
+        }
+
+        _cvar.notify_all();
+    }
+}
+} // namespace utils
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace utils
+{
+// Reads compressed frames on its own thread ahead of the playhead, so decoding never waits for storage.
+// Frames are identified by their number, buffers are pooled and handed back with recycle().
+class read_ahead
+{
+public:
+    struct request
+    {
+        std::string path;
+        uint64_t offset = 0;
+        uint64_t size = 0;            // 0 reads the whole file
+        const char *mapped = nullptr; // Already mapped bytes, copied from here instead of reading the path
+    };
+
+    read_ahead();
+    ~read_ahead();
+
+    // Frames to keep read in playback order, the ones not listed are dropped unless being read right now or claimed
+    void prefetch(const std::vector<std::pair<size_t, request>> &frames);
+
+    // Frame a scheduled task is going to take, read first and kept until taken
+    void claim(size_t frame, const request &);
+
+    // Bytes of a frame, waits for its read or reads it here when it was never queued
+    std::vector<char> take(size_t frame, const request &);
+
+    void recycle(std::vector<char> buffer);
+
+    // Frames to read ahead so they arrive before decoding needs them at given playback rate
+    size_t window(float frame_rate);
+
+    void update_decode_time(double seconds);
+
+private:
+    enum class state_e
+    {
+        QUEUED,
+        READING,
+        READY,
+    };
+
+    struct entry
+    {
+        request source;
+        state_e state = state_e::QUEUED;
+        size_t order = 0; // position in last prefetch, lower is read first
+        bool claimed = false;
+        std::vector<char> buffer;
+    };
+
+    void read(const request &, std::vector<char> &buffer);
+    std::vector<char> acquire_buffer();
+    void io_loop();
+
+    std::mutex _mtx;
+    std::condition_variable _cvar;
+    bool _stopping = false;
+
+    std::map<size_t, entry> _entries;
+    std::vector<std::vector<char>> _free_buffers;
+    size_t _ready_bytes = 0;
+
+    // Running averages in seconds per frame
+    double _read_time = 0;
+    double _decode_time = 0;
+
+    std::thread _io_thread;
+};
+} // namespace utils
@@ -3,6 +3,7 @@
 
 #include <dct.hpp>
 #include <derivative.hpp>
+#include <statistics.hpp>
 
 class dvdb_init
 {
@@ -228,6 +229,90 @@ TEST_CASE_METHOD(dvdb_init, "encode_decode_f32_smooth_values_optimized_max_128_v
     }
 }
 
+TEST_CASE_METHOD(dvdb_init, "separable_matches_tables")
+{
+    dvdb::cube_888_f32 src{}, dct{}, dct_tables{}, res{}, res_tables{};
+
+    uint32_t seed = 12345;
+
+    for (int i = 0; i < std::size(src.values); ++i)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        src.values[i] = static_cast<float>(seed >> 8) / static_cast<float>(1 << 24) - 0.5f;
+    }
+
+    dvdb::dct_3d_encode(&src, &dct);
+    dvdb::dct_3d_encode_tables(&src, &dct_tables);
+
+    for (int i = 0; i < std::size(dct.values); ++i)
+    {
+        REQUIRE_THAT(dct.values[i], Catch::Matchers::WithinAbsMatcher(dct_tables.values[i], 1e-5));
+    }
+
+    dvdb::dct_3d_decode(&dct, &res);
+    dvdb::dct_3d_decode_tables(&dct, &res_tables);
+
+    for (int i = 0; i < std::size(res.values); ++i)
+    {
+        REQUIRE_THAT(res.values[i], Catch::Matchers::WithinAbsMatcher(res_tables.values[i], 1e-5));
+        REQUIRE_THAT(res.values[i], Catch::Matchers::WithinAbsMatcher(src.values[i], 1e-5));
+    }
+}
+
+TEST_CASE_METHOD(dvdb_init, "truncate_f32_smooth_values_within_mse")
+{
+    dvdb::cube_888_f32 src{}, dct{}, res{};
+
+    for (int i = 0; i < std::size(src.values); ++i)
+    {
+        int x = (i & 0b000000111) >> 0;
+        int y = (i & 0b000111000) >> 3;
+        int z = (i & 0b111000000) >> 6;
+
+        src.values[i] = std::cos(x * 0.33 + y * 0.51 + z * 0.13 + 3) * std::cos(y * 0.63 + x * 0.37 + z * 0.44 + 0.3);
+    }
+
+    static constexpr float MAX_MSE = 0.001f;
+
+    dvdb::dct_3d_encode(&src, &dct);
+
+    const int kept = dvdb::dct_3d_truncate(&dct, MAX_MSE);
+
+    int count = 0;
+
+    for (int i = 0; i < std::size(dct.values); ++i)
+    {
+        if (dct.values[i] != 0.f)
+        {
+            ++count;
+        }
+    }
+
+    REQUIRE(count == kept);
+    REQUIRE(kept < 128);
+
+    dvdb::dct_3d_decode(&dct, &res);
+
+    REQUIRE(dvdb::mean_squared_error(&src, &res) <= MAX_MSE * 1.01f);
+}
+
+TEST_CASE_METHOD(dvdb_init, "snap_to_zero_keeps_large_weights")
+{
+    dvdb::cube_888_f32 dct{};
+
+    dct.values[0] = 1.f;
+    dct.values[1] = 0.04f;
+    dct.values[2] = -0.06f;
+    dct.values[3] = -0.01f;
+
+    dvdb::dct_snap_to_zero(&dct, 0.1f);
+
+    REQUIRE(dct.values[0] == 1.f);
+    REQUIRE(dct.values[1] == 0.f);
+    REQUIRE(dct.values[2] == -0.06f);
+    REQUIRE(dct.values[3] == 0.f);
+}
+
 TEST_CASE_METHOD(dvdb_init, "heavy_derivative_compression_255")
 {
     dvdb::cube_888_f32 src{}, dct{}, res{}, dctder{}, dctderdct{}, dctderres{}, dctres{};
@@ -0,0 +1,208 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <entropy.hpp>
+#include <mask.hpp>
+#include <streams.hpp>
+
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace
+{
+std::vector<char> rans_round_trip(const std::vector<char> &input, int *compressed_size = nullptr)
+{
+    std::vector<char> compressed(input.size() + 1024);
+    const int compressed_bytes = dvdb::rans_compress_stream(input.data(), input.size(), compressed.data(), compressed.size());
+    REQUIRE(compressed_bytes >= 0);
+
+    std::vector<char> output(input.size());
+    const int decompressed = dvdb::rans_decompress_stream(compressed.data(), compressed_bytes, output.data(), output.size());
+    REQUIRE(decompressed == input.size());
+
+    if (compressed_size)
+    {
+        *compressed_size = compressed_bytes;
+    }
+
+    return output;
+}
+
+template <typename T>
+void append(std::vector<char> &file, const T &value)
+{
+    file.insert(file.end(), reinterpret_cast<const char *>(&value), reinterpret_cast<const char *>(&value) + sizeof(T));
+}
+
+void append_record(std::vector<char> &file, dvdb::code_points::setup setup, uint8_t reference, uint32_t flags, std::mt19937 &rng)
+{
+    append(file, setup);
+    append(file, reference);
+
+    if (setup.has_source && (flags & dvdb::headers::main::IMPLICIT_SOURCE_KEYS) == 0)
+    {
+        append(file, static_cast<dvdb::code_points::source_key>(rng()));
+    }
+
+    if (setup.has_rotation)
+    {
+        append(file, dvdb::code_points::rotation_offset{.x = 1, .y = -2, .z = 3});
+    }
+
+    if (setup.has_fma_and_new_mask)
+    {
+        append(file, dvdb::code_points::fma::from_float(0.5f, 1.5f));
+
+        dvdb::cube_888_mask mask{}, predicted{};
+        mask.values.set(rng() % 512);
+
+        if (flags & dvdb::headers::main::PREDICTED_MASKS)
+        {
+            // Mix of unchanged, flipped and raw masks
+            for (int i = rng() % 3 * 20; i > 0; --i)
+            {
+                predicted.values.set(rng() % 512);
+            }
+
+            uint8_t encoded[dvdb::MAX_ENCODED_MASK_SIZE];
+            file.insert(file.end(), encoded, encoded + dvdb::encode_mask(&predicted, &mask, encoded));
+        }
+        else
+        {
+            append(file, mask);
+        }
+    }
+
+    if (setup.has_values)
+    {
+        append(file, dvdb::code_points::quantization{.value = 0x1f});
+    }
+
+    if (setup.has_map)
+    {
+        append(file, dvdb::code_points::map{.min = -1.f, .max = 2.f});
+    }
+
+    if (setup.has_values)
+    {
+        dvdb::cube_888_i8 values;
+
+        for (auto &value : values.values)
+        {
+            value = rng() % 7;
+        }
+
+        append(file, values);
+    }
+}
+
+void split_and_join(uint32_t flags)
+{
+    std::mt19937 rng(11);
+
+    dvdb::headers::main header{
+        .frame_type = dvdb::headers::main::frame_type_e::MULTI_REFERENCE_FRAME,
+        .flags = flags,
+        .vdb_grid_count = 2,
+    };
+
+    const bool source_key = (flags & dvdb::headers::main::IMPLICIT_SOURCE_KEYS) == 0;
+
+    std::vector<char> file;
+    append(file, header);
+    file.resize(file.size() + 300, 'b');
+
+    for (uint64_t grid = 0; grid < header.vdb_grid_count; ++grid)
+    {
+        header.frames[grid].diff_data_offset_start = file.size();
+
+        for (int i = 0; i < 200; ++i)
+        {
+            dvdb::code_points::setup setup;
+            const auto bits = static_cast<uint8_t>(rng());
+            std::memcpy(&setup, &bits, sizeof(setup));
+
+            append_record(file, setup, rng() % 3, flags, rng);
+        }
+    }
+
+    std::memcpy(file.data(), &header, sizeof(header));
+
+    dvdb::streams streams;
+    dvdb::split_streams(file.data(), file.size(), streams);
+
+    REQUIRE(streams[static_cast<size_t>(dvdb::stream_e::BASE)].size() == header.frames[0].diff_data_offset_start);
+    REQUIRE(streams[static_cast<size_t>(dvdb::stream_e::MODES)].size() >= 2 * 200 * 2);
+    REQUIRE(streams[static_cast<size_t>(dvdb::stream_e::KEYS)].empty() == !source_key);
+    REQUIRE(dvdb::join_streams(streams) == file);
+
+    const auto *record = file.data() + header.frames[0].diff_data_offset_start;
+    size_t records_size = 0;
+
+    for (int i = 0; i < 200; ++i)
+    {
+        const auto size = dvdb::leaf_record_size(record, header);
+        records_size += size;
+        record += size;
+    }
+
+    REQUIRE(records_size == header.frames[1].diff_data_offset_start - header.frames[0].diff_data_offset_start);
+}
+} // namespace
+
+TEST_CASE("rans_round_trip_skewed_bytes")
+{
+    std::mt19937 rng(7);
+    std::geometric_distribution<int> distribution(0.4);
+    std::vector<char> input(100000);
+
+    for (auto &value : input)
+    {
+        value = static_cast<char>(std::min(distribution(rng), 255));
+    }
+
+    int compressed_size;
+    REQUIRE(rans_round_trip(input, &compressed_size) == input);
+    REQUIRE(compressed_size < input.size() / 2);
+}
+
+TEST_CASE("rans_round_trip_edge_cases")
+{
+    REQUIRE(rans_round_trip({}).empty());
+
+    const std::vector<char> single(4096, 'a');
+    REQUIRE(rans_round_trip(single) == single);
+
+    std::vector<char> every_symbol(256 * 3);
+
+    for (size_t i = 0; i < every_symbol.size(); ++i)
+    {
+        every_symbol[i] = static_cast<char>(i);
+    }
+
+    REQUIRE(rans_round_trip(every_symbol) == every_symbol);
+}
+
+TEST_CASE("rans_rejects_small_output")
+{
+    std::vector<char> input(4096);
+    std::mt19937 rng(3);
+
+    for (auto &value : input)
+    {
+        value = static_cast<char>(rng());
+    }
+
+    std::vector<char> compressed(input.size() / 2);
+    REQUIRE(dvdb::rans_compress_stream(input.data(), input.size(), compressed.data(), compressed.size()) < 0);
+}
+
+TEST_CASE("split_and_join_streams")
+{
+    split_and_join(0);
+}
+
+TEST_CASE("split_and_join_streams_all_flags")
+{
+    split_and_join(dvdb::headers::main::IMPLICIT_SOURCE_KEYS | dvdb::headers::main::DELTA_ROTATIONS | dvdb::headers::main::PREDICTED_MASKS);
+}
@@ -0,0 +1,69 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <mask.hpp>
+
+#include <random>
+
+namespace
+{
+dvdb::cube_888_mask random_mask(std::mt19937 &rng)
+{
+    dvdb::cube_888_mask mask;
+
+    for (int i = 0; i < 512; ++i)
+    {
+        mask.values[i] = rng() & 1;
+    }
+
+    return mask;
+}
+
+size_t round_trip(const dvdb::cube_888_mask &predicted, const dvdb::cube_888_mask &mask)
+{
+    uint8_t encoded[dvdb::MAX_ENCODED_MASK_SIZE];
+    const auto written = dvdb::encode_mask(&predicted, &mask, encoded);
+
+    REQUIRE(dvdb::encoded_mask_size(encoded) == written);
+
+    dvdb::cube_888_mask decoded;
+    REQUIRE(dvdb::decode_mask(encoded, &predicted, &decoded) == written);
+    REQUIRE(decoded.values == mask.values);
+
+    return written;
+}
+} // namespace
+
+TEST_CASE("mask_unchanged_is_one_byte")
+{
+    std::mt19937 rng(1);
+    const auto mask = random_mask(rng);
+
+    REQUIRE(round_trip(mask, mask) == 1);
+}
+
+TEST_CASE("mask_few_flips_smaller_than_raw")
+{
+    std::mt19937 rng(2);
+    const auto predicted = random_mask(rng);
+
+    for (int flips : {1, 5, dvdb::code_points::mask_mode::MAX_FLIPS})
+    {
+        auto mask = predicted;
+
+        while (static_cast<int>((mask.values ^ predicted.values).count()) < flips)
+        {
+            mask.values.flip(rng() % 512);
+        }
+
+        const auto size = round_trip(predicted, mask);
+        REQUIRE(size == 2 + 2 * flips);
+        REQUIRE(size < dvdb::MAX_ENCODED_MASK_SIZE);
+    }
+}
+
+TEST_CASE("mask_many_flips_falls_back_to_raw")
+{
+    std::mt19937 rng(3);
+
+    REQUIRE(round_trip(random_mask(rng), random_mask(rng)) == dvdb::MAX_ENCODED_MASK_SIZE);
+}
@@ -454,6 +454,64 @@ TEST_CASE("Gradient rotation mask")
     }
 }
 
+TEST_CASE("astar candidates")
+{
+    dvdb::cube_888_f32 cubes[27], dst;
+    dvdb::cube_888_f32 *cube_ptrs[27];
+
+    // Noise makes every offset but the right one a poor match, so plain descent from (0, 0, 0) gets stuck
+    uint32_t seed = 12345;
+
+    for (int i = 0; i < 27; ++i)
+    {
+        cube_ptrs[i] = cubes + i;
+
+        for (int j = 0; j < std::size(cubes[i].values); ++j)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            cubes[i].values[j] = static_cast<float>(seed >> 8) / static_cast<float>(1 << 24);
+        }
+    }
+
+    static constexpr glm::ivec3 offset{5, -4, 6};
+    dvdb::rotate_refill(&dst, cube_ptrs, offset.x, offset.y, offset.z);
+
+    glm::ivec3 rot;
+    const dvdb::rotation_candidate candidates[] = {{-2, 3, 1}, {offset.x, offset.y, offset.z}};
+
+    float error = dvdb::rotate_refill_find_astar(&dst, nullptr, cube_ptrs, candidates, std::size(candidates), &rot.x, &rot.y, &rot.z);
+
+    CHECK(rot == offset);
+    CHECK(error == 0.f);
+
+    // Without candidates result can only be as good, never better
+    glm::ivec3 rot_plain;
+    float error_plain = dvdb::rotate_refill_find_astar(&dst, nullptr, cube_ptrs, &rot_plain.x, &rot_plain.y, &rot_plain.z);
+
+    CHECK(error <= error_plain);
+}
+
+TEST_CASE("rotation delta round trip")
+{
+    // Search reaches one step past its limit, so deltas between extremes span the whole 5 bit range and beyond
+    for (int predictor = -8; predictor <= 8; ++predictor)
+    {
+        for (int rotation = -8; rotation <= 8; ++rotation)
+        {
+            const dvdb::code_points::rotation_offset offset{
+                .x = static_cast<int16_t>(dvdb::code_points::wrap_rotation(rotation - predictor)),
+            };
+
+            CHECK(dvdb::code_points::wrap_rotation(offset.x + predictor) == rotation);
+        }
+    }
+
+    const dvdb::code_points::rotation_offset offset{.x = static_cast<int16_t>(dvdb::code_points::wrap_rotation(8 - -8))};
+
+    CHECK(offset.x == -16);
+    CHECK(dvdb::code_points::wrap_rotation(offset.x + -8) == 8);
+}
+
 // TEST_CASE_METHOD(dvdb_init, "find_similars_astar_and_brute_force")
 // {
 //     dvdb::cube_888_f32 cubes[27], dst;
@@ -1,6 +1,7 @@
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/matchers/catch_matchers_floating_point.hpp>
 
+#include <common.hpp>
 #include <statistics.hpp>
 
 TEST_CASE("accumulate")
@@ -103,3 +104,86 @@ TEST_CASE("linear_regression")
     CHECK_THAT(add, Catch::Matchers::WithinAbsMatcher(0.f, 2e-3));
     CHECK_THAT(mul, Catch::Matchers::WithinAbsMatcher(10.f, 1e-5));
 }
+
+TEST_CASE("linear_regression_errors_with_mask")
+{
+    dvdb::cube_888_f32 src, dst, mask, fitted;
+    float add, mul;
+
+    for (int i = 0; i < std::size(src.values); ++i)
+    {
+        src.values[i] = 10.f + (i % 7) * 0.25f;
+        dst.values[i] = 2.f * src.values[i] + 3.f + (i % 3) * 0.1f;
+
+        mask.values[i] = i % 5 == 0 ? 0.f : 1.f;
+    }
+
+    dvdb::linear_regression(&src, &dst, &add, &mul);
+    dvdb::fma(&src, &fitted, add, mul);
+
+    const float expected_pre = dvdb::mean_squared_error_with_mask(&src, &dst, &mask);
+    const float expected_post = dvdb::mean_squared_error_with_mask(&fitted, &dst, &mask);
+
+    float pre, post;
+    dvdb::linear_regression_errors_with_mask(&src, &dst, &mask, &pre, &post);
+
+    CHECK_THAT(pre, Catch::Matchers::WithinRelMatcher(expected_pre, 1e-5));
+    CHECK_THAT(post, Catch::Matchers::WithinRelMatcher(expected_post, 1e-3));
+
+    // exact fit leaves nothing but rounding, never a negative error
+    for (int i = 0; i < std::size(src.values); ++i)
+    {
+        src.values[i] = 100.f + (i % 13) * 0.5f;
+        dst.values[i] = 2.f * src.values[i] + 3.f;
+    }
+
+    dvdb::linear_regression_errors_with_mask(&src, &dst, &mask, &pre, &post);
+
+    CHECK(post >= 0.f);
+    CHECK(post < 1e-8f);
+
+    // near perfect fit far from the first value, expanding residuals from moments cancels to nothing here
+    for (int i = 0; i < std::size(src.values); ++i)
+    {
+        src.values[i] = 1000.f + (i % 13) * 0.5f - (i == 0 ? 900.f : 0.f);
+        dst.values[i] = 2.f * src.values[i] + 3.f + (i % 3) * 0.001f;
+    }
+
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+
+    for (int i = 0; i < std::size(src.values); ++i)
+    {
+        sx += src.values[i];
+        sy += dst.values[i];
+        sxx += double(src.values[i]) * src.values[i];
+        sxy += double(src.values[i]) * dst.values[i];
+    }
+
+    const double n = std::size(src.values);
+    const double exact_mul = (sxy - sx * sy / n) / (sxx - sx * sx / n);
+    const double exact_add = (sy - exact_mul * sx) / n;
+
+    double exact_post = 0;
+
+    for (int i = 0; i < std::size(src.values); ++i)
+    {
+        const double residual = (exact_mul * src.values[i] + exact_add - dst.values[i]) * mask.values[i];
+        exact_post += residual * residual / n;
+    }
+
+    dvdb::linear_regression_errors_with_mask(&src, &dst, &mask, &pre, &post);
+
+    CHECK_THAT(post, Catch::Matchers::WithinRelMatcher(exact_post, 0.05));
+
+    // constant source falls back to plain offset
+    for (int i = 0; i < std::size(src.values); ++i)
+    {
+        src.values[i] = 1.f;
+        dst.values[i] = 4.f;
+    }
+
+    dvdb::linear_regression_errors_with_mask(&src, &dst, &mask, &pre, &post);
+
+    CHECK_THAT(pre, Catch::Matchers::WithinRelMatcher(9.f * 0.8f, 1e-2));
+    CHECK_THAT(post, Catch::Matchers::WithinAbsMatcher(0.f, 1e-6));
+}